@@ -22,8 +22,35 @@
 #include <unistd.h>   // 提供usleep等系统调用
 #endif
 
+// 数据包溢出文件的64位定位（时移缓冲可超过2GB）与清空时截断
+#ifdef _WIN32
+#include <io.h>
+#define spill_fseek _fseeki64
+#define spill_truncate(f) _chsize_s(_fileno(f), 0)
+#else
+#include <unistd.h>
+#define spill_fseek fseeko
+#define spill_truncate(f) ftruncate(fileno(f), 0)
+#endif
+
+// 音量增益内核的SIMD指令集（运行时按av_get_cpu_flags分派）
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GAIN_X86 1
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define GAIN_TARGET(isa) __attribute__((target(isa)))
+#else
+#define GAIN_TARGET(isa)   // MSVC无需单独开启指令集
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define GAIN_NEON 1
+#include <arm_neon.h>
+#endif
+
 // C++11线程支持（原SDL线程逐步迁移）
 #include <thread>     // 未来替换SDL线程的过渡设计
+#include <atomic>     // 无锁队列的原子读写索引与计数
+#include <new>        // 带原子成员的结构体用placement new值初始化
 
 //------------------------ 基础库 --------------------------
 // 标准C库精选头文件（按功能排序）
@@ -62,6 +89,7 @@ extern "C" {
 #include "libswscale/swscale.h"   // 图像缩放
 #include "libavutil/opt.h"        // 参数选项
 #include "libavutil/tx.h"         // 快速变换（FFT）
+#include "libavutil/cpu.h"        // CPU特性检测（SIMD分派）
 #include "libswresample/swresample.h" // 音频重采样
 
 // 滤镜系统
@@ -83,8 +111,13 @@ extern "C" {
 * 音频队列：中容量+固定采样率（防卡顿）
 * 字幕队列：大容量+时间轴复杂度（多语言支持）
 */
-#define MAX_QUEUE_SIZE (15 * 1024 * 1024)  // 总内存警戒线（防止内存溢出）
+#define MAX_QUEUE_SIZE (15 * 1024 * 1024)  // 码率未知时单路流的字节高水位
 #define MIN_FRAMES 25          // 最低解码帧数（保证seek后流畅）
+#define WATERMARK_MIN_BYTES (256 * 1024)          // 按码率推导的字节高水位下限
+#define WATERMARK_MAX_BYTES (1024LL * 1024 * 1024) // 按码率推导的字节高水位上限
+#define BUFFER_TOTAL_MAX_BYTES (1024LL * 1024 * 1024) // 全部数据包队列合计的字节上限（-infbuf不受限）
+#define WATERMARK_UPDATE_INTERVAL 1000000  // 按实测码率刷新字节水位的间隔（微秒）
+#define READ_THREAD_IDLE_TIMEOUT 100 // 读线程水位等待的兜底超时（毫秒）
 #define EXTERNAL_CLOCK_MIN_FRAMES 2  // 外部时钟动态缓冲控制
 #define EXTERNAL_CLOCK_MAX_FRAMES 10
 
@@ -130,28 +163,203 @@ typedef struct MyAVPacketList {
     int serial;         // 序列号（防seek干扰）
 } MyAVPacketList;
 
+/* 关键帧索引项：入队时记录，供队列内前向seek定位 */
+typedef struct KeyframeEntry {
+    int64_t pts;        // 关键帧时间戳（流时间基）
+    int64_t seq;        // 入队序号（与PacketQueue.seq_out比较判断是否已出队）
+} KeyframeEntry;
+
+/* 数据包壳回收池（避免每个包一次av_packet_alloc/av_packet_free）
+* 结构为AVPacket*的SPSC环：
+* - 取用端：入队(put)一侧，池空时才av_packet_alloc（计为miss）
+* - 归还端：只在消费者线程（出队/回收过期包），池满时才av_packet_free（计为release）
+* 取用端与归还端各自只被一个线程使用，因此两种队列模式下都不需要额外加锁
+*/
+#define PACKET_POOL_SIZE     1024   // 池容量（2的幂）
+#define PACKET_POOL_PREALLOC 64     // 初始化时预分配的壳数量
+#define PACKET_BATCH_MAX     32     // 批量入队/出队单次最多搬运的包数
+#define PACKET_QUEUE_STALE_MAX 8    // flush后最多积压的待回收批次
+#define PACKET_RECLAIM_CHUNK 32     // 消费者每次出队顺带回收/空闲回收时每批检查新数据的过期包数
+#define REWIND_DEFAULT_MAX_BYTES (256 * 1024 * 1024) // 回看缓冲默认内存上限（每路流）
+#define PACKET_SPILL_PAGEIN  64     // 内存中剩余包数低于此值时从溢出文件读回一批
+#define PACKET_SPILL_IO_BUF  (1024 * 1024) // 溢出文件stdio缓冲大小
+
+/* 溢出文件中的数据包记录头，其后依次为负载和side data（各带{type, size}头） */
+typedef struct SpillRecord {
+    int64_t pts;
+    int64_t dts;
+    int64_t pos;
+    int64_t duration;
+    int32_t size;
+    int32_t flags;
+    int32_t stream_index;
+    int32_t serial;
+    int32_t nb_side_data;
+} SpillRecord;
+
+typedef struct PacketPool {
+    AVPacket** shells;               // 空闲壳环形数组
+    unsigned mask;                   // 容量-1
+    std::atomic<unsigned> head;      // 归还位置（归还端推进）
+    std::atomic<unsigned> tail;      // 取用位置（取用端推进）
+    std::atomic<int64_t> hits;       // 取用命中次数
+    std::atomic<int64_t> misses;     // 池空改用av_packet_alloc的次数
+    std::atomic<int64_t> releases;   // 归还时池满直接释放的次数
+} PacketPool;
+
+/* 小包slab内存池（-aslab，用于音频队列）
+* 入队时把小负载拷进大块连续内存，每个包只持有块AVBuffer的一个引用，pkt->data指向块内偏移：
+* - 生产者独占当前块，顺序追加，写满后换新块
+* - 块的最后一个引用释放时（任意线程）由自定义free回调放回空闲链表，队列取空时再整块归还系统
+* - 块内只要还有一个包存活（包括回看缓冲中保留的包）整块就无法回收：包按到达顺序填块，
+*   回看窗口实际占用约为played_bytes加首尾各一个块，零星长期持有的包则各自钉住一个256KB块
+* slab单独分配，队列销毁后仍有包引用时由最后一个块的回调完成释放
+*/
+#define PACKET_SLAB_CHUNK      (256 * 1024) // 单块大小
+#define PACKET_SLAB_MAX_PACKET 4096         // 超过此大小的包保留原缓冲区
+#define PACKET_SLAB_FREE_MAX   64           // 空闲链表上限
+#define PACKET_SLAB_KEEP       2            // 队列取空时保留的空闲块数
+
+typedef struct PacketSlab {
+    SDL_mutex* mutex;                        // 保护空闲链表与引用计数
+    uint8_t* free_chunks[PACKET_SLAB_FREE_MAX]; // 空闲块
+    int nb_free;                             // 空闲块数
+    int chunks_out;                          // 仍在使用的块数（含当前块）
+    int closing;                             // 所属队列已销毁
+    AVBufferRef* cur;                        // 当前写入块（仅生产者）
+    size_t cur_off;                          // 当前块写入偏移
+    std::atomic<int64_t> copied;             // 拷入slab的包数
+    std::atomic<int64_t> allocated;          // 新分配的块数
+    std::atomic<int64_t> reused;             // 从空闲链表复用的块数
+} PacketSlab;
+
+/* 等待/持锁时间直方图：按微秒取log2分桶，原子计数供状态显示线程无锁读取
+* 第0桶为<1us，第i桶为[2^(i-1), 2^i)us，最后一桶收纳更长的等待
+*/
+#define QUEUE_HIST_BUCKETS 20
+
+typedef struct WaitHistogram {
+    std::atomic<int64_t> count[QUEUE_HIST_BUCKETS];
+    std::atomic<int64_t> total_us;   // 累计时间
+    std::atomic<int64_t> max_us;     // 单次最长
+} WaitHistogram;
+
 /* 数据包队列（生产者-消费者模型）
 * 关键指标：
 * - nb_packets：当前包数（流控依据）
 * - size：总字节数（内存警戒）
 * - duration：总时长（用于预缓冲计算）
+* 工作模式：
+* - 默认：AVFifo + 互斥锁，每次存取都加锁
+* - SPSC：固定容量环形缓冲 + 原子读写索引，只在队列空/满时阻塞
+*   （仅限一个生产者read_thread和一个消费者解码线程）
+* 统计指标为原子变量，其他线程（流控/状态显示）可无锁读取
 */
 typedef struct PacketQueue {
     AVFifo* pkt_list;      // 环形缓冲区（FFmpeg实现）
-    int nb_packets;        // 有效包数量
-    int size;              // 队列总字节数
-    int64_t duration;      // 队列总时长（单位：流时间基）
+    std::atomic<int> nb_packets;   // 有效包数量
+    std::atomic<int> size;         // 队列总字节数
+    std::atomic<int64_t> duration; // 队列总时长（单位：流时间基）
     int abort_request;     // 中止标志（原子操作）
     int serial;            // 当前队列版本号
+    int serial_floor;      // 出队序列号下限（drop_front换代时不逐个改写队列中剩余的包）
     SDL_mutex* mutex;      // 互斥锁（关键区保护）
     SDL_cond* cond;        // 条件变量（线程唤醒）
+    PacketPool pool;       // 节点AVPacket壳回收池
+    void (*serial_cb)(void *opaque);   // serial变化/中止时的通知（持有mutex调用，不得再取本队列的锁）
+    void* serial_opaque;
+
+    /* flush换下的过期数据（受mutex保护，消费者空闲时回收） */
+    AVFifo* stale[PACKET_QUEUE_STALE_MAX]; // 待回收的过期数据包批次
+    std::atomic<int> nb_stale;             // 待回收批次数（无锁读作为提示）
+    AVFifo* spare;                         // 回收完毕可复用的空FIFO
+    std::atomic<int64_t> flushes;          // flush次数
+    std::atomic<int64_t> reclaimed;        // 已回收的过期包数
+
+    /* 缓冲水位（read_thread按水位流控，降到低水位时由消费者唤醒） */
+    std::atomic<int64_t> low_bytes;    // 低水位字节数（read_thread定期按码率更新）
+    std::atomic<int64_t> high_bytes;   // 高水位字节数（内存上限）
+    double low_sec;                    // 低水位时长（秒）
+    double high_sec;                   // 高水位时长（秒）
+    AVRational time_base;              // duration的时间基
+    int64_t in_bytes;                  // 累计入队字节（码率测算，仅生产者写）
+    int64_t in_duration;               // 累计入队时长（流时间基，仅生产者写）
+    SDL_mutex* reader_mutex;           // read_thread等待用的互斥锁
+    SDL_cond* reader_cond;             // read_thread等待的条件变量
+    std::atomic<int> reader_waiting;   // read_thread正在等待水位回落
+
+    /* 关键帧索引（仅互斥模式，受mutex保护） */
+    AVFifo* kf_index;                  // 队列中关键帧的(pts, 入队序号)，NULL=不建索引
+    int64_t seq_in;                    // 累计入队包数
+    int64_t seq_out;                   // 累计出队/丢弃包数
+
+    /* 回看缓冲（仅互斥模式，受mutex保护）：已出队的数据包继续保留，供向后seek直接回放 */
+    AVFifo* played;                    // 已出队数据包（按出队顺序），NULL=关闭
+    int64_t played_bytes;              // 回看缓冲占用字节
+    int64_t played_duration;           // 回看缓冲总时长（流时间基）
+    int64_t played_max_bytes;          // 内存上限
+    double played_max_sec;             // 时长上限（秒，0=只受内存限制）
+
+    /* 磁盘溢出（仅互斥模式，以下计数受mutex保护）：
+    * 内存中的数据超过预算后，新包按序追加到临时文件，内存侧快取空时再顺序读回；
+    * 一旦开始溢出，后续数据包都写文件直到文件被读空，保证队列顺序。
+    * 文件读写在锁外进行：写端只属于生产者、读端只属于消费者，锁内只登记位置和计数 */
+    FILE* spill_w;                     // 写端（生产者追加）
+    FILE* spill_r;                     // 读端（消费者顺序读回）
+    char* spill_path;                  // Windows下退出时删除的文件路径
+    int64_t spill_budget;              // 内存预算（字节，0=不再溢出）
+    int64_t spill_wpos;                // 写位置（已登记、对读端可见的文件长度）
+    int64_t spill_rpos;                // 读位置
+    int spill_gen;                     // 文件清空代数，锁外读写期间发生清空则结果作废
+    int spill_packets;                 // 文件中待读回的包数
+    int spill_synced;                  // 其中确认已冲刷到文件、读端可直接读到的包数
+    int spill_wgen;                    // 写端文件内容所属的代数（仅生产者）
+    int64_t spill_wtell;               // 写端文件位置，-1=未知（仅生产者）
+    int spill_rgen;                    // 读端缓冲内容所属的代数（仅消费者）
+    int64_t spill_bytes;               // 文件中待读回的数据量（与size同口径）
+    int64_t spill_duration;            // 文件中待读回的时长
+    std::atomic<int64_t> spilled;      // 累计写盘包数
+    std::atomic<int64_t> spill_peak;   // 溢出文件最大长度
+
+    PacketSlab* slab;                  // 小包slab内存池（NULL=关闭）
+
+    /* 争用统计（instrument=1时记录）：区分读线程供给不足与解码线程过慢 */
+    int instrument;                    // 是否记录时间直方图
+    WaitHistogram consumer_wait;       // 解码线程因队列空在cond上等待的时间
+    WaitHistogram producer_wait;       // 读线程因队列满等待的时间（SPSC环满/互斥模式按水位停读）
+    WaitHistogram lock_hold;           // 存取操作持有mutex的时间
+    std::atomic<int64_t> empty_events; // 取包时队列为空的次数
+    std::atomic<int64_t> full_events;  // 入队时队列已满的次数（互斥模式为停读次数）
+
+    /* SPSC无锁模式（spsc=1时pkt_list不使用） */
+    int spsc;                          // 是否启用SPSC环形缓冲
+    MyAVPacketList* ring;              // 环形缓冲区（容量为2的幂）
+    unsigned ring_mask;                // 容量-1（索引取模）
+    std::atomic<unsigned> ring_head;   // 写位置（仅生产者推进）
+    std::atomic<unsigned> ring_tail;   // 读位置（仅消费者/flush推进）
+    std::atomic<int> consumer_waiting; // 消费者因队列空阻塞在cond上
+    std::atomic<int> producer_waiting; // 生产者因队列满阻塞在cond上
+    std::atomic<int> consumer_busy;    // 消费者正在出队（与flush握手）
+    std::atomic<int> flushing;         // flush进行中，消费者需让路
 } PacketQueue;
 
-// 媒体类型帧队列容量（经验值）
+/* 单路流的缓冲水位配置（-abuf/-vbuf/-sbuf）
+* 读线程在高水位停止读取，任一音视频流降到低水位时恢复（滞回）
+* 字节水位<0表示按实测码率自动推导
+*/
+typedef struct BufferWatermarks {
+    double low_sec;        // 低水位时长（秒）
+    double high_sec;       // 高水位时长（秒）
+    int64_t low_bytes;     // 低水位字节数（<0=自动）
+    int64_t high_bytes;    // 高水位字节数（<0=自动）
+} BufferWatermarks;
+
+// 媒体类型帧队列容量（经验值，默认值，可由-vfq/-afq/-sfq覆盖）
 #define VIDEO_PICTURE_QUEUE_SIZE 3  // 1080p每帧约6MB，3帧≈18MB
+#define VIDEO_PICTURE_QUEUE_MAX 8   // 视频帧队列自适应扩容上限
 #define SUBPICTURE_QUEUE_SIZE 16    // 支持复杂字幕时间轴
 #define SAMPLE_QUEUE_SIZE 9         // 200-800ms音频缓冲
-#define FRAME_QUEUE_SIZE FFMAX(SAMPLE_QUEUE_SIZE, FFMAX(VIDEO_PICTURE_QUEUE_SIZE, SUBPICTURE_QUEUE_SIZE))
+#define FRAME_QUEUE_MAX_SIZE 64     // 命令行可设置的最大深度
 
 /* 音频参数集（格式转换关键参数）
 * 典型工作流程：
@@ -165,6 +373,39 @@ typedef struct AudioParams {
     int bytes_per_sec;       // 码率计算（freq * channels * bytes_per_sample）
 } AudioParams;
 
+/* 设备格式PCM环（单生产者audio_thread / 单消费者SDL音频回调）
+* 重采样与同步补偿在audio_thread完成后写入，回调只做拷贝和音量缩放，不加锁也不分配内存。
+* 每段写入附带一个标记（结束位置、结束处的时间、序列号），回调据此计算音频时钟并跳过seek前的旧数据。
+* 环满时生产者登记waiting后阻塞在信号量上，回调腾出空间（读出或跳过旧数据）时才post一次；
+* 暂停时回调不读数据，生产者一直睡眠，不再定时轮询。
+*/
+#define PCM_RING_SECONDS 0.3   // 环的最小时长
+#define PCM_RING_MARKS   512   // 标记环大小（2的幂）
+
+typedef struct PcmMark {
+    int64_t end;         // 本段结束处的累计字节位置
+    double pts;          // 本段结束处的时间（秒），NAN为未知
+    double speed;        // 本段的播放倍速（每秒输出对应的媒体时长）
+    int serial;          // 所属包队列序列号
+} PcmMark;
+
+typedef struct PcmRing {
+    uint8_t *buf;
+    int size;                          // 字节数（2的幂）
+    std::atomic<int64_t> wpos;         // 累计写入字节，只由生产者推进
+    std::atomic<int64_t> rpos;         // 累计读出字节，只由消费者推进
+    PcmMark marks[PCM_RING_MARKS];
+    std::atomic<int64_t> mark_w;       // 已发布的标记数
+    std::atomic<int64_t> mark_r;       // 已读完的标记数
+    double last_pts;                   // 消费者：最近读完一段的结束时间
+    double last_speed;
+    int last_serial;
+    SDL_sem *space;                    // 生产者等待空间（回调/中止时post）
+    std::atomic<int> waiting;          // 生产者已登记等待，回调腾出空间后清零并post
+    std::atomic<int> abort;
+    std::atomic<int64_t> underruns;    // 回调时环中数据不足的次数
+} PcmRing;
+
 /* 播放时钟体系（多时钟源同步）
 * 实现策略：
 * - 音频主时钟：优先保证连续性
@@ -181,11 +422,42 @@ typedef struct Clock {
     int *queue_serial;    // 关联队列版本号（跨线程同步）
 } Clock;
 
+/* 视频帧延迟追踪的各阶段（-trace_latency）
+* 时间戳记录在数据包的opaque_ref（FrameData）里，经copy_opaque随解码帧、滤镜图传到帧队列，
+* 入队时拷入Frame，之后的上传/显示阶段只写这份不共享的副本
+*/
+enum LatencyStage {
+    LAT_DEMUX,      // read_thread读出数据包
+    LAT_SEND,       // 送入解码器
+    LAT_DECODED,    // avcodec_receive_frame返回
+    LAT_FILTERED,   // 从buffersink取出
+    LAT_QUEUED,     // queue_picture拿到帧队列空位
+    LAT_UPLOADED,   // upload_texture完成
+    LAT_PRESENTED,  // SDL_RenderPresent返回
+    LAT_NB
+};
+
 // 帧元数据（调试与定位）
 typedef struct FrameData {
     int64_t pkt_pos;      // 原始文件偏移（用于错误定位）
+    int64_t ts[LAT_NB];   // 各阶段时间戳（av_gettime_relative，0表示未记录）
 } FrameData;
 
+/* 延迟统计：保留最近LATENCY_TRACE_FRAMES帧的样本，报告时排序求精确百分位
+* samples[0]为demux到present的总延迟，samples[i]为阶段i-1到阶段i的耗时（us）
+* 只在主线程（显示与状态输出）读写
+*/
+#define LATENCY_TRACE_FRAMES 1024
+
+typedef struct LatencyTrace {
+    int64_t samples[LAT_NB][LATENCY_TRACE_FRAMES];
+    int nb[LAT_NB];         // 各项有效样本数（不超过LATENCY_TRACE_FRAMES）
+    int pos[LAT_NB];        // 各项下一个写入位置
+    int64_t frames;         // 累计追踪帧数
+    FrameData pending;      // 已上传、等待present的帧的时间戳
+    int has_pending;
+} LatencyTrace;
+
 /* 通用媒体帧容器（视频/音频/字幕）
 * 内存管理策略：
 * - 视频帧：AVFrame引用计数
@@ -205,23 +477,165 @@ typedef struct Frame {
     AVRational sar;       // 像素宽高比（如16:9）
     int uploaded;         // GPU上传标记（避免重复提交）
     int flip_v;           // 垂直翻转标记（某些编码格式需要）
+    FrameData lat;        // 延迟追踪时间戳（-trace_latency，入队时拷出）
 } Frame;
 
+/* 视频解码帧缓冲池（视频解码器的get_buffer2回调）
+* - 按当前分辨率/像素格式为每个平面建一个AVBufferPool，帧经过滤镜图、帧队列后
+*   最后一个引用释放时缓冲回到池中，稳态下解码不再分配大块内存
+* - 平面起始地址与行宽均按FRAME_POOL_ALIGN对齐，swscale与纹理上传没有非对齐尾部
+* - 分辨率/格式变化时重建池，旧池的缓冲由AVBufferPool在引用归零后自行释放
+* - 帧线程解码时回调会被多个线程并发调用，配置检查与取缓冲在mutex内完成
+*/
+#define FRAME_POOL_ALIGN 64
+
+typedef struct FramePool {
+    SDL_mutex* mutex;                   // 保护池配置
+    AVBufferPool* pools[4];             // 每个平面一个池
+    int linesize[4];                    // 对齐后的行宽
+    size_t plane_size[4];               // 每个平面的字节数
+    int nb_planes;                      // 平面数
+    int width, height, format;          // 当前池对应的帧参数（format=-1表示未配置）
+    std::atomic<int64_t> frames;        // 由池分配的帧数
+    std::atomic<int64_t> plane_gets;    // 取出的平面缓冲数
+    std::atomic<int64_t> allocated;     // 新分配的平面缓冲数（其余为复用）
+    std::atomic<int64_t> fallbacks;     // 交给默认分配器的帧数（硬件帧、调色板格式等）
+    std::atomic<int64_t> reconfigs;     // 池重建次数
+} FramePool;
+
+/* GOP并行解码（-gop_parallel）
+* 帧内编码（ProRes/DNxHD/MJPEG/FFV1等）每个包、或声明为封闭GOP的流每个关键帧起的一组包，
+* 互不依赖，可以交给多个独立的解码器上下文同时解码：
+* - 分发线程从videoq取包，切成解码单元，按到达顺序编号后挂到单元链表尾
+* - 解码线程各持一个AVCodecContext，领取最早的待解码单元，解码并冲刷出全部帧
+* - video_thread按编号顺序从链表头取帧（单元内为解码器输出顺序），即按pts顺序送入pictq；
+*   队首单元边解码边交付，不必等整个GOP解完
+* - 已解码未交付的帧数有上限（每个解码线程GOP_FRAMES_PER_WORKER帧），达到上限时解码线程暂停，
+*   封闭GOP再长也只占用固定帧数的内存；在途单元数另有上限，限制缓存的数据包
+*/
+#define GOP_PARALLEL_MAX      32
+#define GOP_FRAMES_PER_WORKER 4     // 每个解码线程可以领先video_thread的帧数
+
+enum {
+    DECODE_UNIT_PENDING,    // 待解码
+    DECODE_UNIT_BUSY,       // 解码中
+    DECODE_UNIT_DONE,       // 已解码（或已作废/结束标记）
+};
+
+typedef struct DecodeUnit {
+    int serial;             // 所属数据包序列号
+    int eof;                // 流结束标记单元（不含数据包）
+    int state;              // DECODE_UNIT_*
+    AVPacket **pkts;        // 单元内的数据包（解码顺序）
+    int nb_pkts, pkts_alloc;
+    AVFrame **frames;       // 解码输出
+    int nb_frames, frames_alloc;
+    int next_frame;         // 下一个交给video_thread的帧
+    struct DecodeUnit *next;// 按分发顺序链接
+} DecodeUnit;
+
+typedef struct GopDecoder {
+    struct GopWorker {
+        struct GopDecoder *gd;
+        AVCodecContext *avctx;
+        SDL_Thread *tid;
+    } workers[GOP_PARALLEL_MAX];
+    int nb_workers;
+    SDL_Thread *dispatcher;     // 分发线程
+    PacketQueue *queue;         // 视频包队列
+    SDL_cond *empty_queue_cond; // 队列取空时唤醒read_thread
+    int key_units;              // 1=按关键帧切分（封闭GOP），0=每个包一个单元（帧内编码）
+    SDL_mutex *mutex;
+    SDL_cond *cond;             // 单元状态变化（分发/解码/交付三方共用）
+    DecodeUnit *head, *tail;    // 未交付完的单元
+    int nb_units;               // 链表中的单元数
+    int max_units;              // 在途单元上限
+    int nb_frames;              // 已解码未交付的帧数
+    int max_frames;             // 已解码未交付的帧数上限
+    int abort;
+    std::atomic<int64_t> units;     // 解码的单元数
+    std::atomic<int64_t> frames;    // 解码输出的帧数
+    std::atomic<int64_t> stale;     // 因seek作废的单元数
+} GopDecoder;
+
+/* 进程级共享工作线程池（-shared_pool）
+* 没有帧线程的解码器以切片模式打开，其execute/execute2与滤镜图的execute都路由到这里，
+* 切片任务的并行度按CPU核数封顶（libavcodec仍会创建自己的切片线程，但它们不再收到任务，一直阻塞空闲）；
+* 帧线程解码器（H.264/HEVC等）不参与，按默认方式使用自己的帧线程：
+* - 每次execute调用是一个批次，调用线程发布批次后自己也领任务执行
+* - 空闲工作线程从任一活动批次按序号原子领取剩余任务（先到先得）
+* - execute2的threadnr是批次内的参与者编号，参与者数不超过avctx->thread_count，
+*   保证解码器按线程数分配的临时缓冲不越界
+* - 按阶段累计任务数和执行时间，用于查看各阶段的核占用
+*/
+#define WORKER_POOL_MAX 64
+
+enum WorkerStage {
+    POOL_STAGE_AUDIO,       // 音频解码
+    POOL_STAGE_VIDEO,       // 视频解码
+    POOL_STAGE_SUBTITLE,    // 字幕解码
+    POOL_STAGE_AFILTER,     // 音频滤镜图
+    POOL_STAGE_VFILTER,     // 视频滤镜图
+    POOL_STAGE_NB
+};
+
+typedef struct PoolBatch {
+    int kind;                   // 0=codec execute 1=codec execute2 2=filter execute
+    void *ctx;                  // AVCodecContext或AVFilterContext
+    void *func;                 // 任务函数（按kind转换）
+    void *arg;                  // 任务参数
+    int *ret;                   // 各任务返回值（可为NULL）
+    int size;                   // execute的参数步长
+    int count;                  // 任务总数
+    int stage;                  // 统计归属的阶段
+    int max_slots;              // 参与线程数上限（含调用线程）
+    int slots;                  // 已参与的线程数（受pool->mutex保护）
+    int active;                 // 正在执行的工作线程数（受pool->mutex保护）
+    std::atomic<int> next;      // 下一个待领取的任务序号
+    struct PoolBatch *link;     // 活动批次链表
+} PoolBatch;
+
+typedef struct WorkerStageStats {
+    std::atomic<int64_t> batches;   // execute调用次数
+    std::atomic<int64_t> jobs;      // 任务数
+    std::atomic<int64_t> busy_us;   // 执行任务的累计时间（所有参与线程之和）
+} WorkerStageStats;
+
+typedef struct WorkerPool {
+    SDL_Thread *threads[WORKER_POOL_MAX];
+    int nb_threads;             // 工作线程数（不含调用线程）
+    SDL_mutex *mutex;
+    SDL_cond *work_cond;        // 有新批次
+    SDL_cond *done_cond;        // 有工作线程退出批次
+    PoolBatch *batches;         // 活动批次
+    int quit;
+    int64_t start_time;         // 创建时间（计算占用率）
+    WorkerStageStats stats[POOL_STAGE_NB];
+} WorkerPool;
+
 /* 帧队列（环形缓冲区实现）
 * 设计要点：
-* - 读写索引分离（无锁访问潜力）
-* - 条件变量唤醒（精确线程控制）
-* - 容量动态调整（根据媒体类型）
+* - 读写索引与帧数为原子变量：写索引只由生产者推进、读索引只由消费者推进，
+*   size以release发布/acquire读取，peek与计数不加锁
+* - 条件变量只在一方确实需要阻塞时使用（登记waiting后复查，对端见到登记才唤醒）
+* - 容量动态调整（根据媒体类型）：环按capacity个槽位分配，
+*   max_size只决定写入端何时等待，运行时调整无需搬移数据
 */
 typedef struct FrameQueue {
-    Frame queue[FRAME_QUEUE_SIZE]; // 固定容量数组
-    int rindex;         // 读位置（消费者）
-    int windex;         // 写位置（生产者）
-    int size;           // 当前帧数
-    int max_size;       // 最大容量（初始化设定）
+    Frame* queue;       // 帧环形数组（堆分配，capacity个槽位）
+    std::atomic<int> rindex;   // 读位置（仅消费者推进）
+    std::atomic<int> windex;   // 写位置（仅生产者推进）
+    std::atomic<int> size;     // 当前帧数（发布/获取帧内容的同步点）
+    std::atomic<int> waiting;  // 阻塞在cond上的线程数（生产者等空位/消费者等新帧）
+    int max_size;       // 当前容量上限（自适应调整，仅生产者线程修改）
+    int capacity;       // 已分配槽位数（max_size的上限）
+    int base_size;      // 初始容量（max_size的下限）
+    int peak_size;      // max_size达到过的最大值
+    double work_mean;   // 单帧生产耗时均值（秒，EWMA，仅生产者线程）
+    double work_var;    // 单帧生产耗时方差
     int keep_last;      // 保留最后一帧（用于暂停）
     int rindex_shown;   // 读位置显示状态
-    SDL_mutex* mutex;   // 互斥锁
+    SDL_mutex* mutex;   // 互斥锁（只配合cond用于阻塞等待）
     SDL_cond* cond;     // 条件变量
     PacketQueue* pktq;  // 关联数据包队列
 } FrameQueue;
@@ -250,8 +664,160 @@ typedef struct Decoder {
     int64_t next_pts;           // 预测时间戳
     AVRational next_pts_tb;     // 预测时间基
     SDL_Thread *decode_thread;  // 解码线程
+
+    /* 批量取包缓存（一次加锁从队列取出多个包，逐个送入解码器） */
+    AVPacket* batch[PACKET_BATCH_MAX]; // 本地缓存的数据包
+    int batch_serial[PACKET_BATCH_MAX];// 对应的序列号
+    int batch_size;             // 单次取包上限（1=逐包获取）
+    int batch_nb;               // 当前缓存的包数
+    int batch_pos;              // 下一个待取的缓存位置
+
+    int64_t wait_us;            // 累计阻塞在取包上的时间（us），负载统计中扣除
+
+    /* 送入解码器前的丢包回调（返回非0则丢弃该包），opaque为回调私有数据 */
+    int (*drop_packet)(void *opaque, const AVPacket *pkt);
+    void *drop_opaque;
 } Decoder;
 
+/* 解码降级控制器（-autodegrade，仅视频）
+* 以单帧解码+滤镜耗时/帧时长的EWMA作为负载：持续过载（或每秒丢帧>2）1秒升一级，
+* 持续有余量5秒降一级。级别依次打开 skip_loop_filter(非参考帧/全部)、skip_idct、
+* skip_frame=nonref。lowres只能在avcodec_open2之前设置，不作为降级级别
+*/
+#define DEGRADE_LEVELS        5
+#define DEGRADE_HIGH_LOAD     0.9   // 负载超过此值视为过载
+#define DEGRADE_LOW_LOAD      0.6   // 负载低于此值视为有余量
+#define DEGRADE_UP_DELAY      1000000   // 持续过载多久升级（us）
+#define DEGRADE_DOWN_DELAY    5000000   // 持续有余量多久降级（us）
+
+typedef struct DegradeController {
+    int level;                  // 当前级别（0=完整解码）
+    int max_level;              // 可用的最高级别
+    enum AVDiscard base_loop_filter, base_idct, base_frame;  // 用户设置的初始值
+    double load;                // 负载EWMA
+    int64_t over_since;         // 持续过载起点（0=当前未过载）
+    int64_t under_since;        // 持续有余量起点
+    int64_t last_change;        // 上次调整级别的时间
+    int64_t last_update;
+    int64_t window_start;       // 丢帧统计窗口（1秒）
+    int window_base, window_drops;
+    int64_t time_at[DEGRADE_LEVELS];    // 各级别累计停留时间（us）
+    int changes;                // 级别调整次数
+} DegradeController;
+
+/* 精确seek（-accurate_seek）
+* 解复用器seek落在目标之前的关键帧，之后视频丢弃目标之前的帧（非参考帧在解码前就丢包，
+* 其余帧解码后不进滤镜、不上传），音频在audio_thread按采样点裁剪，到达目标后才进入pictq/sampq。
+* 读线程在seek前后写入目标和生效的序列号，解码线程只读；*_done只由对应解码线程读写
+*/
+typedef struct AccurateSeek {
+    std::atomic<int64_t> target;        // 目标时间（AV_TIME_BASE）
+    std::atomic<int> video_serial;      // 视频从该序列号起生效（INT_MAX=未生效）
+    std::atomic<int> audio_serial;
+    std::atomic<double> frame_dur;      // 视频帧时长（秒），目标取最近的一帧
+    std::atomic<int64_t> request_time;  // stream_seek被调用的时间
+    int video_done, audio_done;         // 已到达目标的序列号
+    int video_skipped_cur;              // 本次seek已丢弃的视频帧
+
+    /* 统计 */
+    std::atomic<int> count;             // 完成的精确seek次数
+    std::atomic<int64_t> total_time, max_time;  // 到达目标帧的耗时（us）
+    std::atomic<int64_t> video_skipped; // 解码后丢弃的帧
+    std::atomic<int64_t> video_dropped; // 解码前丢弃的非参考帧数据包
+    std::atomic<int64_t> audio_trimmed; // 裁掉的音频采样数
+} AccurateSeek;
+
+/* 关键帧快进/快退（按键 [ ]，8x~64x）
+* 读线程按倍速用索引seek逐个定位关键帧，只把视频关键帧送入队列（视频流discard=nonkey，
+* 音频/字幕discard=all并清空队列即静音），每个关键帧后跟一个空包让解码器立即输出；
+* 停留时间按关键帧间隔/倍速计算。退出时seek回最后显示的关键帧恢复正常播放
+*/
+#define TRICK_STEP        0.1     // 每一步的目标间隔（秒，媒体时间前进 倍速*TRICK_STEP）
+#define TRICK_STEP_MIN    0.04    // 单个关键帧最短停留（秒）
+#define TRICK_STEP_MAX    1.0     // 单个关键帧最长停留（秒）
+#define TRICK_MAX_PACKETS 10000   // seek后找关键帧最多读取的包数
+#define TRICK_SHOW_TIMEOUT 1000000 // 送出的关键帧迟迟未显示（如解码失败）时最多等待多久（us）
+
+static const int trick_speeds[] = { -64, -32, -16, -8, 0, 8, 16, 32, 64 };
+
+/* 变速播放（按键 , .，命令行-rate，0.25x~4x，音调不变）
+* 音频滤镜图末尾插入atempo做时间伸缩，PCM环中每段记录倍速，音频时钟按倍速推进；
+* 倍速变化时尽量直接修改atempo参数，需要增删atempo时先排空旧滤镜图再重建，缓存的样本不丢；
+* 视频/外部时钟speed设为倍速，帧间隔按倍速缩短，跟不上时由现有丢帧逻辑丢帧（落后量按倍速换算为墙钟时间）；
+* 达到PLAYBACK_RATE_SKIP时即使关闭了丢帧，落后的非参考帧数据包也在解码前丢弃
+*/
+#define PLAYBACK_RATE_MIN  0.25
+#define PLAYBACK_RATE_MAX  4.0
+#define PLAYBACK_RATE_SKIP 2.0
+
+static const double playback_rates[] = { 0.25, 0.5, 0.75, 1.0, 1.25, 1.5, 2.0, 3.0, 4.0 };
+
+typedef struct TrickPlay {
+    std::atomic<int> speed;     // 请求的倍速（负数快退，0=正常播放），按键写、读线程读
+    std::atomic<int> active;    // 读线程是否处于关键帧播放
+    std::atomic<int64_t> pos;   // 最近送出的关键帧时间（AV_TIME_BASE）
+    int64_t last_ts;            // 最近送出的关键帧pts（视频流时基）
+    int64_t next_time;          // 下一步的时间（av_gettime_relative）
+    int queued_serial;          // 最近送出的关键帧所在的视频队列序列号（-1=无）
+    int64_t queued_time;        // 送出时间
+    std::atomic<int> shown_serial; // 最近显示的帧的序列号，video_refresh写
+
+    /* 统计 */
+    int steps;                  // 送出的关键帧数
+    int64_t step_time;          // seek+读包累计耗时（us）
+    int64_t packets;            // 累计读取的包数
+} TrickPlay;
+
+/* 倒放（按键 r）
+* 读线程从当前位置起逐个GOP向前seek：每次读出 [关键帧, 下一GOP关键帧及其前导帧] 的视频包并跟一个空包，
+* 解码器按GOP排空；video_thread只保留显示时间落在 [本GOP关键帧, 下一GOP关键帧) 的帧，
+* GOP解码完整后按pts降序送入pictq。音频/字幕静音（同快进快退）
+* -reverse_depth 限制领先于显示的已解码GOP数，-reverse_mem 限制缓存帧内存，超出时先送出已完整的GOP，
+* 仍不够则对当前GOP抽帧
+*/
+#define REVERSE_DEPTH_MAX     8
+#define REVERSE_GOP_RING      (REVERSE_DEPTH_MAX + 2)
+#define REVERSE_MAX_PACKETS   20000   // 单个GOP最多读取的包数
+#define REVERSE_SEEK_RETRY    8       // 无索引时seek未能后退的重试次数（每次多退1秒）
+
+typedef struct ReverseEntry {
+    AVFrame *frame;             // 滤镜输出的帧
+    double pts, duration;
+    int64_t pos;
+    int64_t bytes;              // 帧缓冲大小
+} ReverseEntry;
+
+typedef struct ReverseGop {
+    ReverseEntry *frames;       // 解码输出的帧，GOP完整后按pts降序排列
+    int nb, allocated;
+    int emitted;                // 已送入pictq的帧数
+} ReverseGop;
+
+typedef struct ReversePlay {
+    std::atomic<int> requested;   // 按键切换
+    std::atomic<int> active;      // 读线程是否处于倒放
+    std::atomic<int> serial;      // 倒放数据包的视频队列序列号（-1=无）
+    std::atomic<int64_t> pos;     // 最近送出GOP的起点（AV_TIME_BASE）
+    std::atomic<int> sent;        // 读线程已送出的GOP数
+    std::atomic<int> emitted;     // video_thread已完整送入pictq的GOP数
+    int64_t gop_end;              // 下一个GOP的终点（视频流时基，读线程）
+    double bounds[REVERSE_GOP_RING][2]; // 各GOP的显示时间范围（秒），读线程在送包前写入
+
+    /* 以下只由video_thread访问 */
+    ReverseGop gops[REVERSE_GOP_RING];  // [head, tail)已完整待送出，tail为正在解码的GOP
+    int head, tail;
+    int cache_serial;             // 缓存帧所属的序列号
+    int64_t cache_bytes;
+    int stride, seq;              // 当前GOP的抽帧步长与帧序号
+    int64_t gop_start;            // 当前GOP第一帧输出的时间
+
+    /* 统计 */
+    int gops_done;
+    int64_t decode_time, decode_max;    // GOP解码耗时（第一帧输出到排空，us）
+    int64_t frames, thinned;
+    int64_t peak_bytes;
+} ReversePlay;
+
 /* 全局播放状态机（核心控制结构）
 * - 线程控制：解复用/解码/渲染线程管理
 * - 媒体容器：格式探测/流选择
@@ -264,6 +830,17 @@ typedef struct VideoState {
     SDL_Thread *read_tid;        // 解复用线程
     int abort_request;           // 全局中止标志
     SDL_cond *continue_read_thread; // 读线程暂停控制
+    SDL_mutex *continue_read_mutex; // 与continue_read_thread配对的互斥锁
+    int read_stalls;             // 读线程因缓冲达到高水位而停读的次数
+    int buffer_seeks;            // 在已缓冲数据包内完成的seek次数
+    int demux_seeks;             // 走avformat_seek_file的seek次数
+    int rewind_hits;             // 由回看缓冲完成的向后seek次数
+    int rewind_misses;           // 回看缓冲未覆盖目标、退回解复用器seek的次数
+    LatencyTrace latency;        // 视频帧各阶段延迟（-trace_latency）
+    AccurateSeek aseek;          // 精确seek状态（-accurate_seek）
+    TrickPlay trick;             // 关键帧快进/快退
+    ReversePlay rev;             // 倒放
+    std::atomic<double> rate;    // 播放倍速（按键写，音频/视频解码线程读）
 
     // 媒体容器
     AVFormatContext *ic;         // 格式上下文
@@ -305,10 +882,9 @@ typedef struct VideoState {
         struct SwrContext *swr_ctx; // 重采样上下文
         uint8_t *audio_buf;      // 输出缓冲区
         uint8_t *audio_buf1;     // 备用缓冲区
-        unsigned int audio_buf_size; // 缓冲区大小
         unsigned int audio_buf1_size;
-        int audio_buf_index;     // 当前缓冲位置
-        int audio_write_buf_size;// 待写入大小
+        PcmRing pcm;             // 送往音频回调的设备格式PCM
+        WaitHistogram callback_time; // 音频回调每次的执行时间
 
         double audio_diff_cum;   // 差异累计
         double audio_diff_avg_coef; // 滑动平均系数
@@ -316,6 +892,14 @@ typedef struct VideoState {
         int audio_diff_avg_count; // 平均计数器
         int audio_hw_buf_size;   // 硬件缓冲大小
         int audio_volume;        // 当前音量
+        float audio_gain;        // 回调上次输出结束时的线性增益（音量渐变起点）
+        int64_t frames_direct;   // 直接送入PCM环的帧（格式一致，无需swr）
+        int64_t frames_interleaved; // 只需把平面格式交织的帧
+        int64_t frames_swr;      // 经swr转换或同步补偿的帧
+        double filter_rate;      // 当前滤镜图中atempo的倍速（1=未插入）
+        AVFilterContext *tempo_filter; // 滤镜图中最后一级atempo（倍速变化时直接改参数），NULL=未插入
+        double tempo_pts;        // atempo后首帧的媒体时间，NAN=未开始
+        int64_t tempo_samples;   // atempo后已输出的样本数
         int muted;               // 静音状态
     } audio;
 
@@ -325,12 +909,17 @@ typedef struct VideoState {
         PacketQueue videoq;      // 视频包队列
         AVStream *video_st;      // 视频流
         FrameQueue pictq;        // 图像队列
+        FramePool *frame_pool;   // 解码帧缓冲池（跨流切换复用，stream_close时释放）
+        GopDecoder *gop;         // GOP并行解码（-gop_parallel，未开启时为NULL）
+        DegradeController degrade; // 解码降级控制（-autodegrade）
 
         struct SwsContext *sub_convert_ctx; // 字幕转换
         struct SwsContext *img_convert_ctx; // 图像转换
         AVRational sar;          // 像素宽高比
         int frame_drops_early;   // 主动丢帧计数
         int frame_drops_late;    // 延迟丢帧计数
+        int frame_drops_pkt;     // 解码前丢弃的非参考帧数据包计数
+        int frame_skips_rate;    // 高倍速播放时解码前跳过的非参考帧数据包计数
 
         SDL_Texture *vid_texture;// 视频纹理
         double frame_timer;      // 帧计时器
@@ -397,7 +986,6 @@ typedef struct VideoState {
 
     // 新增状态
     int read_pause_return;       // 读线程暂停返回值
-    int frame_drops_late;        // 延迟丢帧计数
     double audio_clock;          // 当前音频时钟
     int audio_clock_serial;      // 音频时钟序列号
 } VideoState;
@@ -494,6 +1082,41 @@ static int64_t start_time = AV_NOPTS_VALUE;     // 开始时间
 static int64_t duration = AV_NOPTS_VALUE;       // 播放时长
 static int autoexit;
 static int fast = 0;    //加速解码
+static int spsc_queue = 0;               // 数据包队列使用SPSC无锁环形缓冲
+static int spsc_queue_size = 4096;       // SPSC环形缓冲容量（包个数，向上取2的幂）
+static int packet_batch_size = 8;        // 批量入队/出队的包数（1=关闭批量）
+static int buffer_seek = 1;              // 前向seek目标已在缓冲内时不再调用avformat_seek_file
+static double rewind_max_sec = 0;        // 回看缓冲时长（秒，-rewind 30s）
+static int64_t rewind_max_bytes = 0;     // 回看缓冲内存上限（字节，-rewind 64M）
+static int64_t spill_budget = 0;         // 每个队列的内存预算，超出部分写入临时文件（0=关闭）
+static char *spill_dir;                  // 溢出文件目录（默认TMPDIR/TEMP）
+static int queue_stats = -1;             // 记录数据包队列的等待/持锁时间直方图（-1=随显式-stats开启）
+static int audio_slab = 0;               // 音频队列的小包负载拷入slab内存池
+static int audio_float = 1;              // 优先向SDL申请F32输出（-noafloat固定为S16）
+static int video_frame_pool = 1;         // 视频解码帧缓冲走对齐的FramePool（-novpool关闭）
+static int packet_drop = 1;              // 视频落后时解码前丢弃非参考帧数据包（-nopktdrop关闭）
+static int accurate_seek = 0;            // seek后精确定位到目标帧（-accurate_seek）
+static int reverse_depth = 2;            // 倒放预解码的GOP数（-reverse_depth）
+static int reverse_mem = 512;            // 倒放帧缓存上限（MB，-reverse_mem）
+static double playback_rate = 1.0;       // 初始播放倍速（-rate，0.25~4）
+static int latency_trace = 0;            // 记录视频帧各阶段时间戳并统计延迟分位（-trace_latency）
+static int shared_pool = 0;              // 解码器与滤镜图共享一个工作线程池（-shared_pool）
+static int shared_pool_threads = 0;      // 共享池工作线程数（0=CPU核数-1）
+static WorkerPool *worker_pool;          // 共享池实例（ffplay_main创建，do_exit销毁）
+static int gop_parallel = 0;             // 帧内编码视频的并行解码器个数（0=关闭）
+static int gop_closed = 0;               // 声明视频流为封闭GOP，按关键帧切分解码单元
+static int auto_degrade = 0;             // 过载时逐级降低视频解码质量（-autodegrade）
+static int video_frame_queue = VIDEO_PICTURE_QUEUE_SIZE;    // 视频帧队列初始深度（-vfq）
+static int video_frame_queue_max = VIDEO_PICTURE_QUEUE_MAX; // 视频帧队列自适应上限（-vfq_max）
+static int sample_frame_queue = SAMPLE_QUEUE_SIZE;          // 音频帧队列深度（-afq）
+static int subtitle_frame_queue = SUBPICTURE_QUEUE_SIZE;    // 字幕帧队列深度（-sfq）
+static BufferWatermarks buffer_watermarks[AVMEDIA_TYPE_NB] = { // 按AVMediaType索引
+    { 1.0, 3.0, -1, -1 },   // 视频
+    { 1.0, 3.0, -1, -1 },   // 音频
+    { 0.0, 0.0, -1, -1 },   // 数据（不缓冲）
+    { 0.0, 0.0, -1, -1 },   // 字幕（稀疏流，只受字节水位约束）
+    { 0.0, 0.0, -1, -1 },   // 附件
+};
 static int find_stream_info = 1;
 static int dump_media_info = 0;          // 打印输入媒体的元数据摘要
 static int list_audio_devices = 0;       // 列出SDL可用音频设备
@@ -531,6 +1154,287 @@ static enum AVColorSpace sdl_supported_color_spaces[] = {
 };
 
 
+/* 记录一次耗时到直方图 */
+static void wait_histogram_add(WaitHistogram *h, int64_t us)
+{
+    int bucket = 0;
+    int64_t max = h->max_us.load(std::memory_order_relaxed);
+
+    if (us < 0)
+        us = 0;
+    while (bucket < QUEUE_HIST_BUCKETS - 1 && (INT64_C(1) << bucket) <= us)
+        bucket++;
+    h->count[bucket].fetch_add(1, std::memory_order_relaxed);
+    h->total_us.fetch_add(us, std::memory_order_relaxed);
+    while (us > max && !h->max_us.compare_exchange_weak(max, us, std::memory_order_relaxed))
+        ;
+}
+
+/* 直方图样本数 */
+static int64_t wait_histogram_count(const WaitHistogram *h)
+{
+    int64_t n = 0;
+    for (int i = 0; i < QUEUE_HIST_BUCKETS; i++)
+        n += h->count[i].load(std::memory_order_relaxed);
+    return n;
+}
+
+/* 百分位数（返回所在桶的上界，单位us），无样本时为0 */
+static int64_t wait_histogram_percentile(const WaitHistogram *h, double p)
+{
+    int64_t n = wait_histogram_count(h), acc = 0;
+
+    for (int i = 0; i < QUEUE_HIST_BUCKETS && n > 0; i++) {
+        acc += h->count[i].load(std::memory_order_relaxed);
+        if (acc >= p * n)
+            return i < QUEUE_HIST_BUCKETS - 1 ? INT64_C(1) << i : h->max_us.load();
+    }
+    return 0;
+}
+
+/* 队列计时：未开启统计时不取时钟 */
+static int64_t packet_queue_clock(PacketQueue *q)
+{
+    return q->instrument ? av_gettime_relative() : 0;
+}
+
+static void packet_queue_record(PacketQueue *q, WaitHistogram *h, int64_t start)
+{
+    if (q->instrument)
+        wait_histogram_add(h, av_gettime_relative() - start);
+}
+
+/* slab结构体释放（closing且没有块在使用时调用） */
+static void packet_slab_release(PacketSlab *slab)
+{
+    SDL_DestroyMutex(slab->mutex);
+    av_free(slab);
+}
+
+/* 块AVBuffer的free回调：可能在任意线程触发，块放回空闲链表 */
+static void packet_slab_free_chunk(void *opaque, uint8_t *data)
+{
+    PacketSlab *slab = (PacketSlab *)opaque;
+    int last;
+
+    SDL_LockMutex(slab->mutex);
+    if (!slab->closing && slab->nb_free < PACKET_SLAB_FREE_MAX) {
+        slab->free_chunks[slab->nb_free++] = data;
+        data = NULL;
+    }
+    last = --slab->chunks_out == 0 && slab->closing;
+    SDL_UnlockMutex(slab->mutex);
+    av_free(data);
+    if (last)
+        packet_slab_release(slab);
+}
+
+static PacketSlab *packet_slab_alloc(void)
+{
+    PacketSlab *slab = (PacketSlab *)av_mallocz(sizeof(*slab));
+
+    if (!slab)
+        return NULL;
+    if (!(slab->mutex = SDL_CreateMutex())) {
+        av_free(slab);
+        return NULL;
+    }
+    return slab;
+}
+
+/* 换一个新的当前块（生产者调用），优先复用空闲块 */
+static int packet_slab_next_chunk(PacketSlab *slab)
+{
+    uint8_t *data = NULL;
+
+    av_buffer_unref(&slab->cur);
+    SDL_LockMutex(slab->mutex);
+    if (slab->nb_free)
+        data = slab->free_chunks[--slab->nb_free];
+    SDL_UnlockMutex(slab->mutex);
+    if (data)
+        slab->reused.fetch_add(1, std::memory_order_relaxed);
+    else if ((data = (uint8_t *)av_malloc(PACKET_SLAB_CHUNK)))
+        slab->allocated.fetch_add(1, std::memory_order_relaxed);
+    else
+        return AVERROR(ENOMEM);
+
+    slab->cur = av_buffer_create(data, PACKET_SLAB_CHUNK, packet_slab_free_chunk, slab, 0);
+    if (!slab->cur) {
+        av_free(data);
+        return AVERROR(ENOMEM);
+    }
+    SDL_LockMutex(slab->mutex);
+    slab->chunks_out++;
+    SDL_UnlockMutex(slab->mutex);
+    slab->cur_off = 0;
+    return 0;
+}
+
+/* 小包负载拷入slab（生产者调用），失败时保持原包不变 */
+static void packet_slab_copy(PacketSlab *slab, AVPacket *pkt)
+{
+    size_t need = FFALIGN(pkt->size + AV_INPUT_BUFFER_PADDING_SIZE, 64);
+    AVBufferRef *ref;
+    uint8_t *dst;
+
+    if (pkt->size <= 0 || pkt->size > PACKET_SLAB_MAX_PACKET)
+        return;
+    if ((!slab->cur || slab->cur_off + need > PACKET_SLAB_CHUNK) && packet_slab_next_chunk(slab) < 0)
+        return;
+    if (!(ref = av_buffer_ref(slab->cur)))
+        return;
+
+    dst = slab->cur->data + slab->cur_off;
+    memcpy(dst, pkt->data, pkt->size);
+    memset(dst + pkt->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    slab->cur_off += need;
+
+    av_buffer_unref(&pkt->buf);
+    pkt->buf = ref;
+    pkt->data = dst;
+    slab->copied.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+* 队列取空时摘下多余的空闲块（调用方持有队列锁），返回块数
+* 释放由调用方解锁后用packet_slab_free_chunks完成，整块归还系统不占用队列锁
+*/
+static int packet_slab_trim(PacketSlab *slab, uint8_t **chunks)
+{
+    int n = 0;
+
+    SDL_LockMutex(slab->mutex);
+    while (slab->nb_free > PACKET_SLAB_KEEP)
+        chunks[n++] = slab->free_chunks[--slab->nb_free];
+    SDL_UnlockMutex(slab->mutex);
+    return n;
+}
+
+static void packet_slab_free_chunks(uint8_t **chunks, int n)
+{
+    while (n > 0)
+        av_free(chunks[--n]);
+}
+
+/* slab销毁：仍有块被数据包引用时延迟到最后一个块释放 */
+static void packet_slab_destroy(PacketSlab **pslab)
+{
+    PacketSlab *slab = *pslab;
+    int last;
+
+    if (!slab)
+        return;
+    *pslab = NULL;
+    av_buffer_unref(&slab->cur);
+    SDL_LockMutex(slab->mutex);
+    slab->closing = 1;
+    while (slab->nb_free)
+        av_freep(&slab->free_chunks[--slab->nb_free]);
+    last = slab->chunks_out == 0;
+    SDL_UnlockMutex(slab->mutex);
+    if (last)
+        packet_slab_release(slab);
+}
+
+/* 回收池初始化：分配壳数组并预热PACKET_POOL_PREALLOC个空包 */
+static int packet_pool_init(PacketPool *pool)
+{
+    unsigned i;
+
+    pool->shells = (AVPacket **)av_calloc(PACKET_POOL_SIZE, sizeof(*pool->shells));
+    if (!pool->shells)
+        return AVERROR(ENOMEM);
+    pool->mask = PACKET_POOL_SIZE - 1;
+    for (i = 0; i < PACKET_POOL_PREALLOC; i++) {
+        if (!(pool->shells[i] = av_packet_alloc())) {
+            while (i > 0)       // 释放已预热的空壳，池保持未初始化状态
+                av_packet_free(&pool->shells[--i]);
+            av_freep(&pool->shells);
+            return AVERROR(ENOMEM);
+        }
+    }
+    pool->head.store(i);
+    return 0;
+}
+
+/* 取用一个空壳（取用端调用），池空时回退到堆分配 */
+static AVPacket *packet_pool_get(PacketPool *pool)
+{
+    unsigned tail = pool->tail.load(std::memory_order_relaxed);
+
+    if (tail != pool->head.load(std::memory_order_acquire)) {
+        AVPacket *pkt = pool->shells[tail & pool->mask];
+        pool->tail.store(tail + 1, std::memory_order_release);
+        pool->hits.fetch_add(1, std::memory_order_relaxed);
+        return pkt;
+    }
+    pool->misses.fetch_add(1, std::memory_order_relaxed);
+    return av_packet_alloc();
+}
+
+/* 归还一个空壳（归还端调用，pkt必须已unref），池满时直接释放 */
+static void packet_pool_put(PacketPool *pool, AVPacket *pkt)
+{
+    unsigned head = pool->head.load(std::memory_order_relaxed);
+
+    if (head - pool->tail.load(std::memory_order_acquire) <= pool->mask) {
+        pool->shells[head & pool->mask] = pkt;
+        pool->head.store(head + 1, std::memory_order_release);
+        return;
+    }
+    pool->releases.fetch_add(1, std::memory_order_relaxed);
+    av_packet_free(&pkt);
+}
+
+/* 回收池销毁：释放池中剩余的全部空壳 */
+static void packet_pool_destroy(PacketPool *pool)
+{
+    unsigned tail = pool->tail.load(), head = pool->head.load();
+
+    if (!pool->shells)
+        return;
+    for (; tail != head; tail++)
+        av_packet_free(&pool->shells[tail & pool->mask]);
+    pool->tail.store(tail);
+    av_freep(&pool->shells);
+}
+
+/* 数据包的展示时间戳，缺失时退回解码时间戳 */
+static int64_t packet_queue_pkt_ts(const AVPacket *pkt)
+{
+    return pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+}
+
+/* 剔除已出队数据包对应的关键帧索引项（需持有锁） */
+static void packet_queue_prune_index(PacketQueue *q)
+{
+    KeyframeEntry kf;
+
+    while (av_fifo_peek(q->kf_index, &kf, 1, 0) >= 0 && kf.seq < q->seq_out)
+        av_fifo_drain2(q->kf_index, 1);
+}
+
+/* 入队统计与关键帧索引（内存入队与写溢出文件共用，需持有锁） */
+static void packet_queue_account_put(PacketQueue *q, const AVPacket *pkt)
+{
+    // 更新队列统计指标
+    q->nb_packets++;  // 数据包计数+1
+    q->size += pkt->size + sizeof(MyAVPacketList); // 内存占用增加（数据包+元数据）
+    q->duration += pkt->duration; // 累计时长（基于时间基）
+    q->in_bytes += pkt->size;     // 码率测算
+    q->in_duration += pkt->duration;
+
+    /* 记录关键帧位置（索引写入失败只影响队列内seek命中） */
+    if (q->kf_index && (pkt->flags & AV_PKT_FLAG_KEY)) {
+        KeyframeEntry kf = { packet_queue_pkt_ts(pkt), q->seq_in };
+        packet_queue_prune_index(q);
+        if (kf.pts != AV_NOPTS_VALUE)
+            av_fifo_write(q->kf_index, &kf, 1);
+    }
+    q->seq_in++;
+}
+
 /* 数据包队列内部写入实现（线程安全需由外部锁保证） */
 static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt)
 {
@@ -550,45 +1454,458 @@ static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt)
     if (ret < 0)
         return ret; // 返回FFmpeg错误码（通常为ENOMEM）
 
-    // 更新队列统计指标
-    q->nb_packets++;  // 数据包计数+1
-    q->size += pkt1.pkt->size + sizeof(pkt1); // 内存占用增加（数据包+元数据）
-    q->duration += pkt1.pkt->duration; // 累计时长（基于时间基）
+    packet_queue_account_put(q, pkt);
 
     /* 特殊处理提示：DV格式需要深拷贝数据（当前未实现） */
     // 注：DV视频的每个包包含多个帧，直接引用可能引发问题
 
-    // 唤醒等待线程
-    SDL_CondSignal(q->cond);  // 触发条件变量通知消费者
+    // 唤醒消费者由调用方在整批写入后统一完成（一次signal）
     return 0;
 }
 
-/* 数据包入队公共接口（线程安全封装） */
-static int packet_queue_put(PacketQueue *q, AVPacket *pkt)
+/* 是否应把下一个包写入溢出文件：文件中还有未读回的包（保序），或内存侧超出预算 */
+static int packet_queue_should_spill(PacketQueue *q, const AVPacket *pkt)
+{
+    return q->spill_w && (q->spill_packets > 0 ||
+           (q->spill_budget > 0 && q->size - q->spill_bytes + pkt->size > q->spill_budget));
+}
+
+/* 把一个数据包序列化追加到文件，*len返回记录长度 */
+static int packet_spill_write(FILE *f, const AVPacket *pkt, int serial, int64_t *len)
+{
+    SpillRecord rec = { pkt->pts, pkt->dts, pkt->pos, pkt->duration, pkt->size,
+                        pkt->flags, pkt->stream_index, serial, pkt->side_data_elems };
+
+    *len = sizeof(rec) + pkt->size;
+    if (fwrite(&rec, sizeof(rec), 1, f) != 1 ||
+        (pkt->size > 0 && fwrite(pkt->data, pkt->size, 1, f) != 1))
+        return AVERROR(EIO);
+    for (int i = 0; i < pkt->side_data_elems; i++) {
+        const AVPacketSideData *sd = &pkt->side_data[i];
+        int32_t hdr[2] = { sd->type, (int32_t)sd->size };
+
+        if (fwrite(hdr, sizeof(hdr), 1, f) != 1 ||
+            (sd->size > 0 && fwrite(sd->data, sd->size, 1, f) != 1))
+            return AVERROR(EIO);
+        *len += sizeof(hdr) + sd->size;
+    }
+    return 0;
+}
+
+/* 从文件当前位置读回一个数据包（pkt须为空包），*len返回记录长度 */
+static int packet_spill_read(FILE *f, AVPacket *pkt, int *serial, int64_t *len)
+{
+    SpillRecord rec;
+
+    if (fread(&rec, sizeof(rec), 1, f) != 1 || rec.size < 0 || rec.nb_side_data < 0)
+        return AVERROR(EIO);
+    /* 空包（解码器冲刷标记）保持data为NULL */
+    if (rec.size > 0 && (av_new_packet(pkt, rec.size) < 0 || fread(pkt->data, rec.size, 1, f) != 1))
+        return AVERROR(EIO);
+    *len = sizeof(rec) + rec.size;
+    for (int i = 0; i < rec.nb_side_data; i++) {
+        int32_t hdr[2];
+        uint8_t *sd;
+
+        if (fread(hdr, sizeof(hdr), 1, f) != 1 || hdr[1] < 0 ||
+            !(sd = av_packet_new_side_data(pkt, (enum AVPacketSideDataType)hdr[0], hdr[1])) ||
+            (hdr[1] > 0 && fread(sd, hdr[1], 1, f) != 1))
+            return AVERROR(EIO);
+        *len += sizeof(hdr) + hdr[1];
+    }
+    pkt->pts = rec.pts;
+    pkt->dts = rec.dts;
+    pkt->pos = rec.pos;
+    pkt->duration = rec.duration;
+    pkt->flags = rec.flags;
+    pkt->stream_index = rec.stream_index;
+    *serial = rec.serial;
+    return 0;
+}
+
+/*
+* 数据包写入溢出文件（生产者线程，调用时持有锁）
+* 写文件期间释放锁，写完后在锁内登记；记录先留在stdio缓冲中，
+* 读端读到已冲刷部分的末尾时才冲刷（见packet_queue_spill_read），顺序写入不逐条落盘。
+* 文件清空后的第一次写入先截断文件，作废的数据不继续占用磁盘
+* @return 0已写入（调用方unref原包），1文件期间被清空、改为放入内存，<0失败
+*/
+static int packet_queue_spill_put(PacketQueue *q, AVPacket *pkt)
+{
+    int64_t pos = q->spill_wpos, len = 0;
+    int gen = q->spill_gen, serial = q->serial;
+    int ret = 0;
+
+    if (q->abort_request)
+        return -1;
+    SDL_UnlockMutex(q->mutex);
+    if (gen != q->spill_wgen)   // 新一代从头写（此时pos为0）
+        ret = spill_fseek(q->spill_w, 0, SEEK_SET) < 0 || spill_truncate(q->spill_w) ? AVERROR(EIO) : 0;
+    else if (pos != q->spill_wtell)
+        ret = spill_fseek(q->spill_w, pos, SEEK_SET) < 0 ? AVERROR(EIO) : 0;
+    if (ret >= 0) {
+        q->spill_wgen = gen;
+        ret = packet_spill_write(q->spill_w, pkt, serial, &len);
+    }
+    q->spill_wtell = ret >= 0 ? pos + len : -1;
+    SDL_LockMutex(q->mutex);
+
+    if (q->spill_gen != gen)
+        return q->abort_request ? -1 : 1;   // 消费者已读空并清空文件，本条记录作废，内存侧仍保持顺序
+    if (ret < 0) {
+        if (q->spill_budget)
+            av_log(NULL, AV_LOG_ERROR, "Packet spill file write failed, spilling disabled\n");
+        q->spill_budget = 0;
+        return ret;
+    }
+    q->spill_wpos += len;
+    q->spill_packets++;
+    q->spill_bytes += pkt->size + sizeof(MyAVPacketList);
+    q->spill_duration += pkt->duration;
+    q->spilled.fetch_add(1, std::memory_order_relaxed);
+    if (q->spill_wpos > q->spill_peak)
+        q->spill_peak = q->spill_wpos;
+    packet_queue_account_put(q, pkt);
+    return 0;
+}
+
+/* 队列当前是否有数据包在溢出文件中 */
+static int packet_queue_spilling(PacketQueue *q)
+{
+    int ret;
+
+    if (!q->spill_w)
+        return 0;
+    SDL_LockMutex(q->mutex);
+    ret = q->spill_packets > 0;
+    SDL_UnlockMutex(q->mutex);
+    return ret;
+}
+
+/* 溢出文件清空后从头复用（需持有锁，不碰文件本身：写端下次写入时截断，读端下次读取时丢弃缓冲） */
+static void packet_queue_spill_reset(PacketQueue *q)
+{
+    q->spill_packets = 0;
+    q->spill_synced = 0;
+    q->spill_bytes = 0;
+    q->spill_duration = 0;
+    q->spill_wpos = q->spill_rpos = 0;
+    q->spill_gen++;
+}
+
+/*
+* 从溢出文件顺序读回最多max个数据包追加到内存FIFO（仅消费者线程，调用时持有锁）
+* 读文件期间释放锁，读完后在锁内追加；期间发生flush（文件被清空）则读到的包作废。
+* 已冲刷的记录不够本批读取时先冲刷写端缓冲（stdio的FILE自带锁，可与生产者的写入并发），
+* 此时已登记的记录都已完整写入缓冲；文件换代后先丢弃读端缓冲，避免读到上一代的旧内容。
+* 文件中的包总是排在内存中所有包之后，因此直接追加即可保持顺序；
+* 节点壳用av_packet_alloc分配（回收池的取用端属于生产者），用完后照常还回池中
+*/
+static void packet_queue_spill_read(PacketQueue *q, int max)
+{
+    MyAVPacketList pkts[PACKET_SPILL_PAGEIN];
+    int64_t lens[PACKET_SPILL_PAGEIN];
+    int64_t pos = q->spill_rpos;
+    int gen = q->spill_gen, nb = 0, n, failed = 0;
+    int synced = -1;
+
+    max = FFMIN(FFMIN(max, q->spill_packets), PACKET_SPILL_PAGEIN);  // 只读已登记的记录
+    if (q->spill_synced < max)
+        synced = q->spill_packets;
+    SDL_UnlockMutex(q->mutex);
+    if (synced >= 0 && fflush(q->spill_w))
+        failed = 1;
+    if (gen != q->spill_rgen) {
+        fflush(q->spill_r);     // 使下面的fseek不复用缓冲中的旧数据
+        q->spill_rgen = gen;
+    }
+    if (!failed && spill_fseek(q->spill_r, pos, SEEK_SET) < 0)
+        failed = 1;
+    for (; !failed && nb < max; nb++) {
+        if (!(pkts[nb].pkt = av_packet_alloc()))
+            break;      // 下次再试
+        if (packet_spill_read(q->spill_r, pkts[nb].pkt, &pkts[nb].serial, &lens[nb]) < 0) {
+            av_packet_free(&pkts[nb].pkt);
+            failed = 1;
+            break;
+        }
+    }
+    SDL_LockMutex(q->mutex);
+
+    if (synced >= 0 && q->spill_gen == gen)
+        q->spill_synced = synced;   // 冲刷前已登记的记录都已落盘
+    /* 期间已flush（文件已清空）时读到的包全部作废 */
+    for (n = 0; n < nb && q->spill_gen == gen; n++) {
+        if (av_fifo_write(q->pkt_list, &pkts[n], 1) < 0) {
+            failed = 1;
+            break;
+        }
+        q->spill_rpos += lens[n];
+        q->spill_packets--;
+        q->spill_synced--;
+        q->spill_bytes -= pkts[n].pkt->size + sizeof(pkts[n]);
+        q->spill_duration -= pkts[n].pkt->duration;
+    }
+    for (; n < nb; n++)
+        av_packet_free(&pkts[n].pkt);
+    if (q->spill_gen != gen)
+        return;
+    if (failed && q->spill_packets > 0) {
+        /* 文件读取失败：丢弃文件中剩余的数据包，队列退回纯内存模式 */
+        av_log(NULL, AV_LOG_ERROR, "Packet spill file read failed, dropping %d packets\n", q->spill_packets);
+        q->nb_packets -= q->spill_packets;
+        q->size -= q->spill_bytes;
+        q->duration -= q->spill_duration;
+        q->spill_budget = 0;
+    }
+    if (!q->spill_packets || failed)
+        packet_queue_spill_reset(q);
+}
+
+/* 队列缓冲时长（秒），时间基未设置时为0 */
+static double packet_queue_seconds(PacketQueue *q)
+{
+    return q->time_base.den ? q->duration * av_q2d(q->time_base) : 0;
+}
+
+/* 是否低于低水位：队列为空，或字节/时长任一低于低水位 */
+static int packet_queue_below_low(PacketQueue *q)
+{
+    return q->nb_packets == 0 || q->size < q->low_bytes ||
+           (q->duration > 0 && packet_queue_seconds(q) < q->low_sec);
+}
+
+/* 相对高水位的填充百分比（字节与时长取较大者） */
+static int packet_queue_fill_percent(PacketQueue *q)
+{
+    double fill = 0;
+    if (q->high_bytes > 0)
+        fill = (double)q->size / q->high_bytes;
+    if (q->high_sec > 0)
+        fill = FFMAX(fill, packet_queue_seconds(q) / q->high_sec);
+    return (int)(fill * 100);
+}
+
+/* 实测入队码率（字节/秒），样本不足2秒时返回0 */
+static double packet_queue_input_rate(PacketQueue *q)
+{
+    double in_sec = q->time_base.den ? q->in_duration * av_q2d(q->time_base) : 0;
+    return in_sec >= 2.0 ? q->in_bytes / in_sec : 0;
+}
+
+/* 绑定read_thread的等待条件，出队后据此做低水位唤醒 */
+static void packet_queue_set_reader(PacketQueue *q, SDL_mutex *mutex, SDL_cond *cond)
+{
+    q->reader_mutex = mutex;
+    q->reader_cond = cond;
+}
+
+/* 出队后检查水位：read_thread在等待且已降到低水位时唤醒它 */
+static void packet_queue_wake_reader(PacketQueue *q)
+{
+    if (q->reader_waiting.load() && q->reader_cond && packet_queue_below_low(q)) {
+        SDL_LockMutex(q->reader_mutex);
+        SDL_CondSignal(q->reader_cond);
+        SDL_UnlockMutex(q->reader_mutex);
+    }
+}
+
+/* SPSC模式批量入队（仅由唯一的生产者线程调用）
+* 快路径只有原子读写：一次写入尽可能多的槽位后统一发布写位置，
+* 环形缓冲满时才在cond上阻塞等待消费者腾出空间
+* 返回值：成功写入的节点数（小于nb表示队列已中止，剩余节点由调用方释放）
+*/
+static int packet_queue_spsc_put_batch(PacketQueue *q, AVPacket **nodes, int nb)
+{
+    unsigned head = q->ring_head.load(std::memory_order_relaxed);
+    int done = 0;
+
+    while (done < nb) {
+        unsigned space;
+        int n;
+
+        if (q->abort_request)
+            break;
+        space = q->ring_mask + 1 - (head - q->ring_tail.load(std::memory_order_acquire));
+        if (!space) {
+            /* 队列满：登记等待后复查，避免与消费者出队错过唤醒 */
+            SDL_LockMutex(q->mutex);
+            q->producer_waiting.store(1);
+            if (!q->abort_request && head - q->ring_tail.load() > q->ring_mask) {
+                int64_t wait = packet_queue_clock(q);
+                q->full_events.fetch_add(1, std::memory_order_relaxed);
+                SDL_CondWait(q->cond, q->mutex);
+                packet_queue_record(q, &q->producer_wait, wait);
+            }
+            q->producer_waiting.store(0);
+            SDL_UnlockMutex(q->mutex);
+            continue;
+        }
+
+        n = FFMIN((int)space, nb - done);
+        for (int i = 0; i < n; i++) {
+            MyAVPacketList *slot = &q->ring[(head + i) & q->ring_mask];
+            AVPacket *pkt = nodes[done + i];
+
+            slot->pkt = pkt;
+            slot->serial = q->serial;
+            // 统计先于发布更新，保证消费者扣减时计数不会为负
+            q->nb_packets.fetch_add(1, std::memory_order_relaxed);
+            q->size.fetch_add(pkt->size + (int)sizeof(*slot), std::memory_order_relaxed);
+            q->duration.fetch_add(pkt->duration, std::memory_order_relaxed);
+            q->in_bytes += pkt->size;       // 码率测算
+            q->in_duration += pkt->duration;
+        }
+        head += n;
+        done += n;
+
+        q->ring_head.store(head);   // 发布（顺序一致，与consumer_waiting构成握手）
+        if (q->consumer_waiting.load()) {
+            SDL_LockMutex(q->mutex);
+            SDL_CondSignal(q->cond);
+            SDL_UnlockMutex(q->mutex);
+        }
+    }
+    return done;
+}
+
+/* SPSC模式批量出队（仅由唯一的消费者线程调用）
+* 数据转移到pkts，节点壳在握手窗口内归还回收池（与flush互斥）
+* 返回值：取到的包数，0=队列空，-1=flush进行中需稍后重试
+*/
+static int packet_queue_spsc_pop_batch(PacketQueue *q, AVPacket **pkts, int *serials, int max)
 {
-    AVPacket* pkt1;             // 新数据包指针
-    int ret;                    // 操作返回值
-
-    /* 创建新数据包副本 */
-    pkt1 = av_packet_alloc();   // 分配空AVPacket结构体
-    if (!pkt1) {                // 内存分配失败处理
-        av_packet_unref(pkt);   // 释放输入数据包引用
-        return -1;              // 返回内存不足错误
+    unsigned tail, head;
+    int n;
+
+    /* 与flush握手：先声明占用再检查flush标志（双方均为顺序一致操作） */
+    q->consumer_busy.store(1);
+    if (q->flushing.load()) {
+        q->consumer_busy.store(0);
+        return -1;
+    }
+
+    tail = q->ring_tail.load(std::memory_order_relaxed);
+    head = q->ring_head.load(std::memory_order_acquire);
+    n = FFMIN((int)(head - tail), max);
+    for (int i = 0; i < n; i++) {
+        MyAVPacketList *pkt1 = &q->ring[(tail + i) & q->ring_mask];
+
+        q->nb_packets.fetch_sub(1, std::memory_order_relaxed);
+        q->size.fetch_sub(pkt1->pkt->size + (int)sizeof(*pkt1), std::memory_order_relaxed);
+        q->duration.fetch_sub(pkt1->pkt->duration, std::memory_order_relaxed);
+        av_packet_move_ref(pkts[i], pkt1->pkt);
+        if (serials)
+            serials[i] = pkt1->serial;
+        packet_pool_put(&q->pool, pkt1->pkt);
+    }
+    if (n)
+        q->ring_tail.store(tail + n);   // 一次释放全部槽位
+    q->consumer_busy.store(0);
+
+    if (n && q->producer_waiting.load()) {
+        SDL_LockMutex(q->mutex);
+        SDL_CondSignal(q->cond);
+        SDL_UnlockMutex(q->mutex);
+    }
+    return n;
+}
+
+/*
+* 批量入队（一次加锁、一次唤醒搬运nb个数据包）
+* 所有pkts的引用都会被转移（失败时被释放），调用后pkts均为空包
+* 返回值: 0成功，<0失败（队列中止或内存不足）
+*/
+static int packet_queue_put_batch(PacketQueue *q, AVPacket **pkts, int nb)
+{
+    AVPacket *nodes[PACKET_BATCH_MAX];
+    int64_t held;
+    int i, n, ret = 0;
+
+    if (q->slab && !q->abort_request) {
+        for (i = 0; i < nb; i++)
+            packet_slab_copy(q->slab, pkts[i]);
+    }
+
+    if (q->spsc) {
+        while (nb > 0) {
+            /* 生产者独占回收池取用端，无需加锁 */
+            n = FFMIN(nb, PACKET_BATCH_MAX);
+            for (i = 0; i < n; i++) {
+                if (!(nodes[i] = packet_pool_get(&q->pool)))
+                    break;
+                av_packet_move_ref(nodes[i], pkts[i]);
+            }
+            if (i < n) {
+                ret = AVERROR(ENOMEM);
+                n = i;
+            }
+            i = packet_queue_spsc_put_batch(q, nodes, n);  // 无锁快路径
+            if (i < n)
+                ret = -1;
+            for (; i < n; i++)
+                av_packet_free(&nodes[i]);  // 归还端属于消费者，这里直接释放
+            if (ret < 0)
+                break;
+            pkts += n;
+            nb   -= n;
+        }
+        for (i = 0; i < nb; i++)
+            av_packet_unref(pkts[i]);
+        return ret;
     }
-    av_packet_move_ref(pkt1, pkt);  // 转移数据包所有权（原pkt被置空）
 
     /* 临界区开始 */
     SDL_LockMutex(q->mutex);    // 获取队列互斥锁
-    ret = packet_queue_put_private(q, pkt1);  // 调用内部写入方法
-    SDL_UnlockMutex(q->mutex);  // 释放互斥锁
+    held = packet_queue_clock(q);
+
+    for (i = 0; i < nb; i++) {
+        /* 超出内存预算：顺序写入溢出文件，不占用节点壳 */
+        if (packet_queue_should_spill(q, pkts[i])) {
+            packet_queue_record(q, &q->lock_hold, held);
+            ret = packet_queue_spill_put(q, pkts[i]);   // 写文件期间不持锁
+            held = packet_queue_clock(q);
+            if (ret < 0)
+                break;
+            if (!ret) {
+                av_packet_unref(pkts[i]);
+                continue;
+            }
+        }
 
-    /* 错误处理 */
-    if (ret < 0)                // 内部写入失败
-        av_packet_free(&pkt1);  // 释放新建的数据包
+        /* 从回收池取节点壳（池空时才堆分配） */
+        AVPacket *pkt1 = packet_pool_get(&q->pool);
+        if (!pkt1) {            // 内存分配失败处理
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        av_packet_move_ref(pkt1, pkts[i]);  // 转移数据包所有权（原pkt被置空）
+
+        ret = packet_queue_put_private(q, pkt1);  // 调用内部写入方法
+        if (ret < 0) {
+            /* 写入失败时释放节点（归还端属于消费者线程） */
+            av_packet_free(&pkt1);
+            break;
+        }
+    }
+    if (i > 0)
+        SDL_CondSignal(q->cond);  // 整批只唤醒一次消费者
 
+    packet_queue_record(q, &q->lock_hold, held);
+    SDL_UnlockMutex(q->mutex);  // 释放互斥锁
+
+    /* 错误处理：释放未能入队的输入数据包 */
+    for (; i < nb; i++)
+        av_packet_unref(pkts[i]);
     return ret;                 // 返回操作结果
 }
 
+/* 数据包入队公共接口（线程安全封装） */
+static int packet_queue_put(PacketQueue *q, AVPacket *pkt)
+{
+    return packet_queue_put_batch(q, &pkt, 1) < 0 ? -1 : 0;
+}
+
 /* 空数据包入队接口（用于刷新解码器） */
 static int packet_queue_put_nullpacket(PacketQueue* q, AVPacket* pkt, int stream_index)
 {
@@ -599,8 +1916,8 @@ static int packet_queue_put_nullpacket(PacketQueue* q, AVPacket* pkt, int stream
 /* 数据包队列初始化函数（线程安全基础设施准备） */
 static int packet_queue_init(PacketQueue *q)
 {
-    // 清空队列结构体（避免残留数据）
-    memset(q, 0, sizeof(PacketQueue));
+    // 值初始化清空队列结构体（含原子成员，不能memset）
+    new (q) PacketQueue();
 
     /* 创建自动扩容的FIFO缓冲区 */
     q->pkt_list = av_fifo_alloc2(
@@ -615,51 +1932,299 @@ static int packet_queue_init(PacketQueue *q)
     q->mutex = SDL_CreateMutex();
     if (!q->mutex) {            // 创建失败处理
         av_log(NULL, AV_LOG_FATAL, "SDL互斥锁创建失败: %s\n", SDL_GetError());
-        return AVERROR(ENOMEM); // 返回系统错误码
+        goto fail;
     }
 
     /* 初始化条件变量 */
     q->cond = SDL_CreateCond();
     if (!q->cond) {             // 创建失败处理
         av_log(NULL, AV_LOG_FATAL, "SDL条件变量创建失败: %s\n", SDL_GetError());
-        return AVERROR(ENOMEM);
+        goto fail;
     }
 
+    /* 预热节点壳回收池 */
+    if (packet_pool_init(&q->pool) < 0)
+        goto fail;
+
     /* 初始状态设置 */
     q->abort_request = 1;       // 初始为中止状态（需手动启动）
+    q->instrument = queue_stats < 0 ? show_status == 1 : queue_stats;  // 计时有开销，默认关闭
     return 0;                   // 返回成功状态
+
+fail:
+    /* 释放已创建的部分，队列回到未初始化状态 */
+    SDL_DestroyCond(q->cond);
+    SDL_DestroyMutex(q->mutex);
+    av_fifo_freep2(&q->pkt_list);
+    q->cond = NULL;
+    q->mutex = NULL;
+    return AVERROR(ENOMEM);
+}
+
+/* SPSC模式队列初始化（容量向上取2的幂，最少16个包） */
+static int packet_queue_init_spsc(PacketQueue *q, int capacity)
+{
+    unsigned n = 16;
+    int ret = packet_queue_init(q);
+    if (ret < 0)
+        return ret;
+
+    while (n < (unsigned)capacity && n < (1U << 20))
+        n <<= 1;
+    q->ring = (MyAVPacketList *)av_calloc(n, sizeof(*q->ring));
+    if (!q->ring)
+        return AVERROR(ENOMEM);
+    q->ring_mask = n - 1;
+    q->spsc = 1;
+    return 0;
+}
+
+/* 为队列建立关键帧索引（仅互斥模式，用于视频队列的队列内seek） */
+static int packet_queue_init_index(PacketQueue *q)
+{
+    if (q->spsc)
+        return 0;
+    q->kf_index = av_fifo_alloc2(16, sizeof(KeyframeEntry), AV_FIFO_FLAG_AUTO_GROW);
+    return q->kf_index ? 0 : AVERROR(ENOMEM);
+}
+
+/* 开启回看缓冲（仅互斥模式），max_sec为0时只受内存上限约束 */
+static int packet_queue_init_rewind(PacketQueue *q, double max_sec, int64_t max_bytes)
+{
+    if (q->spsc)
+        return 0;
+    q->played = av_fifo_alloc2(64, sizeof(MyAVPacketList), AV_FIFO_FLAG_AUTO_GROW);
+    if (!q->played)
+        return AVERROR(ENOMEM);
+    q->played_max_sec = max_sec;
+    q->played_max_bytes = max_bytes;
+    return 0;
+}
+
+/* 开启小包slab内存池（两种队列模式均可用：拷贝只发生在生产者一侧） */
+static int packet_queue_init_slab(PacketQueue *q)
+{
+    q->slab = packet_slab_alloc();
+    return q->slab ? 0 : AVERROR(ENOMEM);
+}
+
+/*
+* 开启磁盘溢出（仅互斥模式）：在dir下创建临时文件，分别以写端/读端打开
+* 非Windows平台打开后立即删除目录项，进程退出时由系统回收磁盘空间
+*/
+static int packet_queue_init_spill(PacketQueue *q, int64_t budget, const char *dir)
+{
+    static std::atomic<int> spill_seq;
+    char *path;
+
+    if (q->spsc)
+        return 0;
+    if (!dir && !(dir = getenv("TMPDIR")) && !(dir = getenv("TEMP")))
+        dir = ".";
+    path = av_asprintf("%s/ffplay-spill-%" PRId64 "-%d.bin", dir, av_gettime(), spill_seq++);
+    if (!path)
+        return AVERROR(ENOMEM);
+    if (!(q->spill_w = fopen(path, "w+b")) || !(q->spill_r = fopen(path, "rb"))) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot create packet spill file %s\n", path);
+        if (q->spill_w)
+            remove(path);
+        av_free(path);
+        return AVERROR(EIO);
+    }
+#ifdef _WIN32
+    q->spill_path = path;   // 打开中的文件不能删除，销毁队列时再删
+#else
+    remove(path);
+    av_free(path);
+#endif
+    setvbuf(q->spill_w, NULL, _IOFBF, PACKET_SPILL_IO_BUF);
+    setvbuf(q->spill_r, NULL, _IOFBF, PACKET_SPILL_IO_BUF);
+    q->spill_budget = budget;
+    return 0;
+}
+
+/* 同步释放一个FIFO中的全部数据包（非消费者线程使用，节点壳直接释放不回池） */
+static void packet_queue_free_list(AVFifo *list)
+{
+    MyAVPacketList pkt1;
+
+    while (av_fifo_read(list, &pkt1, 1) >= 0)
+        av_packet_free(&pkt1.pkt);
 }
 
-/* 数据包队列清空函数（线程安全的内存释放与状态重置） */
+/* 取一个空FIFO用于替换/收纳过期数据（需持有锁）
+* 优先复用回收完毕的备用FIFO；待回收批次已满或分配失败时返回NULL，由调用方同步释放
+*/
+static AVFifo *packet_queue_take_spare(PacketQueue *q)
+{
+    AVFifo *list = q->spare;
+
+    if (q->nb_stale >= PACKET_QUEUE_STALE_MAX)
+        return NULL;
+    if (list)
+        q->spare = NULL;
+    else
+        list = av_fifo_alloc2(1, sizeof(MyAVPacketList), AV_FIFO_FLAG_AUTO_GROW);
+    return list;
+}
+
+/* 递增serial使旧数据失效，并通知在别处等待本队列serial的线程（需持有锁） */
+static void packet_queue_next_serial(PacketQueue *q)
+{
+    q->serial++;
+    if (q->serial_cb)
+        q->serial_cb(q->serial_opaque);
+}
+
+/*
+* 数据包队列清空函数（seek时调用，O(1)代际切换）
+* 只递增serial并换下底层存储，过期数据包挂入stale列表，
+* 由消费者每次出队顺带释放一小批、队列空闲时集中释放（见packet_queue_reclaim）
+*/
 static void packet_queue_flush(PacketQueue *q)
 {
-    MyAVPacketList pkt1;  // 临时存储从队列取出的数据包
+    AVFifo *list;
 
     /* 临界区开始：加锁保证原子操作 */
     SDL_LockMutex(q->mutex);
 
-    /* 循环释放所有数据包 */
-    while (av_fifo_read(q->pkt_list, &pkt1, 1) >= 0) {
-        av_packet_free(&pkt1.pkt);  // 释放AVPacket内存
+    if (q->spsc) {
+        unsigned tail, head;
+        int64_t size = 0, duration = 0;
+
+        /* 暂时接管消费端：等待正在进行的出队完成（只有几条指令） */
+        q->flushing.store(1);
+        while (q->consumer_busy.load())
+            std::this_thread::yield();
+
+        tail = q->ring_tail.load(std::memory_order_relaxed);
+        head = q->ring_head.load(std::memory_order_acquire);
+        if (tail != head) {
+            /* 生产者仍在写环，无法整体换掉存储：只把节点指针挪进stale列表，不做释放 */
+            list = packet_queue_take_spare(q);
+            for (unsigned i = tail; i != head; i++) {
+                MyAVPacketList *pkt1 = &q->ring[i & q->ring_mask];
+                size += pkt1->pkt->size + (int)sizeof(*pkt1);
+                duration += pkt1->pkt->duration;
+                if (!list || av_fifo_write(list, pkt1, 1) < 0)
+                    av_packet_free(&pkt1->pkt);
+            }
+            if (list)
+                q->stale[q->nb_stale++] = list;
+
+            // 生产者可能并发入队，只扣减本次换下的部分
+            q->nb_packets.fetch_sub((int)(head - tail), std::memory_order_relaxed);
+            q->size.fetch_sub(size, std::memory_order_relaxed);
+            q->duration.fetch_sub(duration, std::memory_order_relaxed);
+        }
+        q->ring_tail.store(head);
+        packet_queue_next_serial(q);
+        q->flushes.fetch_add(1, std::memory_order_relaxed);
+        q->flushing.store(0);
+        if (q->producer_waiting.load())
+            SDL_CondSignal(q->cond);
+        SDL_UnlockMutex(q->mutex);
+        return;
+    }
+
+    /* 换上空FIFO，旧FIFO整体挂入待回收列表 */
+    if (av_fifo_can_read(q->pkt_list)) {
+        if ((list = packet_queue_take_spare(q))) {
+            q->stale[q->nb_stale++] = q->pkt_list;
+            q->pkt_list = list;
+        } else {
+            packet_queue_free_list(q->pkt_list);  // 回收积压过多时退化为同步释放
+        }
     }
 
     /* 重置队列统计指标 */
     q->nb_packets = 0;    // 数据包计数器归零
     q->size = 0;          // 内存占用量归零
     q->duration = 0;      // 总时长归零
+    q->seq_out = q->seq_in;
+    if (q->kf_index)
+        av_fifo_reset2(q->kf_index);
+
+    /* 回看缓冲与新位置不再连续，同样整体换下 */
+    if (q->played && av_fifo_can_read(q->played)) {
+        if ((list = packet_queue_take_spare(q))) {
+            q->stale[q->nb_stale++] = q->played;
+            q->played = list;
+        } else {
+            packet_queue_free_list(q->played);
+        }
+    }
+    q->played_bytes = 0;
+    q->played_duration = 0;
+    if (q->spill_w)
+        packet_queue_spill_reset(q);   // 文件中的旧数据直接作废，O(1)
 
     /* 更新队列序列号（重要！）*/
-    q->serial++;          // 使旧序列号的数据包失效
+    packet_queue_next_serial(q);    // 使旧序列号的数据包失效
+    q->flushes.fetch_add(1, std::memory_order_relaxed);
 
     /* 临界区结束：释放互斥锁 */
     SDL_UnlockMutex(q->mutex);
 }
 
+/*
+* 回收flush换下的过期数据包（仅消费者线程调用）
+* 调用时持有锁，内部释放锁后unref并把节点壳还回回收池；
+* budget>0时最多回收budget个（每次出队顺带调用，保证过期批次不会一直积压到flush同步释放），
+* budget=0时在队列空闲时调用，每PACKET_RECLAIM_CHUNK个检查一次，有新包到达就让路，剩余部分留到下次
+*/
+static void packet_queue_reclaim(PacketQueue *q, int budget)
+{
+    AVFifo *list = q->stale[--q->nb_stale];
+    MyAVPacketList pkt1;
+    int n = 0;
+
+    SDL_UnlockMutex(q->mutex);
+    while (av_fifo_read(list, &pkt1, 1) >= 0) {
+        av_packet_unref(pkt1.pkt);
+        packet_pool_put(&q->pool, pkt1.pkt);
+        if (++n == budget || (!(n % PACKET_RECLAIM_CHUNK) && (q->nb_packets > 0 || q->abort_request)))
+            break;
+    }
+    q->reclaimed.fetch_add(n, std::memory_order_relaxed);
+    SDL_LockMutex(q->mutex);
+
+    if (av_fifo_can_read(list)) {
+        if (q->nb_stale < PACKET_QUEUE_STALE_MAX) {
+            q->stale[q->nb_stale++] = list;  // 留到下次空闲继续回收
+            return;
+        }
+        packet_queue_free_list(list);        // 期间又发生多次flush，直接释放
+    }
+    if (!q->spare)
+        q->spare = list;
+    else
+        av_fifo_freep2(&list);
+}
+
 /* 数据包队列销毁函数（全资源释放与清理） */
 static void packet_queue_destroy(PacketQueue *q)
 {
     packet_queue_flush(q);
+    for (int i = 0; i < q->nb_stale; i++) {
+        packet_queue_free_list(q->stale[i]);
+        av_fifo_freep2(&q->stale[i]);
+    }
+    q->nb_stale = 0;
+    av_fifo_freep2(&q->spare);
     av_fifo_freep2(&q->pkt_list);
+    av_fifo_freep2(&q->kf_index);
+    av_fifo_freep2(&q->played);
+    packet_slab_destroy(&q->slab);
+    if (q->spill_w)
+        fclose(q->spill_w);
+    if (q->spill_r)
+        fclose(q->spill_r);
+    if (q->spill_path)
+        remove(q->spill_path);
+    av_freep(&q->spill_path);
+    av_freep(&q->ring);
+    packet_pool_destroy(&q->pool);
     SDL_DestroyMutex(q->mutex);
     SDL_DestroyCond(q->cond);
 }
@@ -672,6 +2237,8 @@ static void packet_queue_abort(PacketQueue *q)
     q->abort_request = 1;       // 设置中止标志位（1=请求终止）
 
     SDL_CondSignal(q->cond);    // 触发条件变量唤醒等待线程
+    if (q->serial_cb)
+        q->serial_cb(q->serial_opaque);
 
     SDL_UnlockMutex(q->mutex);  // 释放互斥锁
 }
@@ -681,60 +2248,444 @@ static void packet_queue_start(PacketQueue *q)
 {
     SDL_LockMutex(q->mutex);    // 获取队列互斥锁
     q->abort_request = 0;       // 清除中止标志位（0=正常运作）
-    q->serial++;                // 递增序列号使旧数据失效
+    packet_queue_next_serial(q);    // 递增序列号使旧数据失效
     SDL_UnlockMutex(q->mutex);  // 释放互斥锁
 }
 
+/* 淘汰超出时长/内存上限的最旧回看数据（仅消费者线程，需持有锁） */
+static void packet_queue_trim_played(PacketQueue *q)
+{
+    MyAVPacketList pkt1;
+
+    while ((q->played_bytes > q->played_max_bytes ||
+            (q->played_max_sec > 0 && q->time_base.den &&
+             q->played_duration * av_q2d(q->time_base) > q->played_max_sec)) &&
+           av_fifo_read(q->played, &pkt1, 1) >= 0) {
+        q->played_bytes -= pkt1.pkt->size;
+        q->played_duration -= pkt1.pkt->duration;
+        av_packet_unref(pkt1.pkt);
+        packet_pool_put(&q->pool, pkt1.pkt);
+    }
+}
+
 /*
-* 从数据包队列获取数据包（线程安全的阻塞/非阻塞操作）
+* 出队的数据包留一份在回看缓冲中（需持有锁）
+* 调用方拿到的是同一缓冲区的新引用，节点本身转入played；
+* 未开启回看缓冲、空包或非引用计数包返回<0，由调用方按常规路径转移
+*/
+static int packet_queue_keep_played(PacketQueue *q, MyAVPacketList *pkt1, AVPacket *dst)
+{
+    if (!q->played || !pkt1->pkt->buf)
+        return -1;
+    if (av_packet_ref(dst, pkt1->pkt) < 0)
+        return -1;
+    if (av_fifo_write(q->played, pkt1, 1) < 0) {
+        av_packet_unref(dst);
+        return -1;
+    }
+    q->played_bytes += pkt1->pkt->size;
+    q->played_duration += pkt1->pkt->duration;
+    packet_queue_trim_played(q);
+    return 0;
+}
+
+/*
+* 批量出队：一次加锁最多取max个数据包（阻塞模式下至少等到1个）
+* pkts/serials由调用方提供，pkts须为空包
 * 返回值:
 *   <0: 队列已中止
 *    0: 无数据包且非阻塞模式
-*   >0: 成功获取数据包
+*   >0: 实际取到的数据包个数
 */
-static int packet_queue_get(PacketQueue* q, AVPacket* pkt, int block, int* serial)
+static int packet_queue_get_batch(PacketQueue* q, AVPacket** pkts, int max, int block, int* serials)
 {
     MyAVPacketList pkt1; // 临时存储从队列取出的数据包节点
-    int ret;             // 操作返回值
+    uint8_t *chunks[PACKET_SLAB_FREE_MAX]; // 待归还的slab空闲块
+    int64_t held, wait;  // 持锁/等待计时起点
+    int ret, n;          // 操作返回值/摘下的slab块数
+
+    if (q->spsc) {
+        for (;;) {
+            if (q->abort_request)
+                return -1;
+            ret = packet_queue_spsc_pop_batch(q, pkts, serials, max);
+            if (ret > 0) {
+                if (q->nb_stale.load(std::memory_order_relaxed)) {
+                    SDL_LockMutex(q->mutex);
+                    if (q->nb_stale)
+                        packet_queue_reclaim(q, PACKET_RECLAIM_CHUNK);
+                    SDL_UnlockMutex(q->mutex);
+                }
+                packet_queue_wake_reader(q);
+                return ret;
+            }
+            if (!block)
+                return 0;
+
+            /* 队列空或flush中：登记等待后复查，flush持锁期间这里自然排队 */
+            SDL_LockMutex(q->mutex);
+            if (q->nb_stale) {
+                packet_queue_reclaim(q, 0);  // 空闲时间先回收过期数据包
+                SDL_UnlockMutex(q->mutex);
+                continue;
+            }
+            if (q->slab && (n = packet_slab_trim(q->slab, chunks)) > 0) {
+                SDL_UnlockMutex(q->mutex);
+                packet_slab_free_chunks(chunks, n);    // 多余的slab块解锁后整块归还
+                continue;
+            }
+            q->consumer_waiting.store(1);
+            if (!q->abort_request &&
+                q->ring_tail.load(std::memory_order_relaxed) == q->ring_head.load()) {
+                q->empty_events.fetch_add(1, std::memory_order_relaxed);
+                wait = packet_queue_clock(q);
+                SDL_CondWait(q->cond, q->mutex);
+                packet_queue_record(q, &q->consumer_wait, wait);
+            }
+            q->consumer_waiting.store(0);
+            SDL_UnlockMutex(q->mutex);
+        }
+    }
 
     SDL_LockMutex(q->mutex); // 进入临界区，加锁保证原子操作
+    held = packet_queue_clock(q);
 
-    for (;;) {
+    for (ret = 0;;) {
         // 检查队列中止请求
         if (q->abort_request) {
             ret = -1;    // 设置中止返回值
             break;       // 退出循环
         }
 
-        // 尝试从FIFO读取数据包节点
-        if (av_fifo_read(q->pkt_list, &pkt1, 1) >= 0) {
+        // 内存侧快取空时从溢出文件读回下一批
+        if (q->spill_packets > 0 && av_fifo_can_read(q->pkt_list) < PACKET_SPILL_PAGEIN) {
+            packet_queue_record(q, &q->lock_hold, held);
+            packet_queue_spill_read(q, PACKET_SPILL_PAGEIN);    // 读文件期间不持锁
+            held = packet_queue_clock(q);
+        }
+
+        // 尝试从FIFO读取数据包节点，一次尽量取满
+        while (ret < max && av_fifo_read(q->pkt_list, &pkt1, 1) >= 0) {
             /* 成功读取数据包后的处理流程 */
             q->nb_packets--;  // 更新队列包计数器
             q->size -= pkt1.pkt->size + sizeof(pkt1); // 更新内存占用量
             q->duration -= pkt1.pkt->duration; // 更新总时长统计
+            q->seq_out++;
 
-            av_packet_move_ref(pkt, pkt1.pkt); // 转移数据包所有权（零拷贝）
-            if (serial)
-                *serial = pkt1.serial; // 返回数据包序列号
-            av_packet_free(&pkt1.pkt); // 释放队列节点内存
-
-            ret = 1;      // 设置成功返回值
-            break;        // 退出循环
+            if (serials)
+                serials[ret] = FFMAX(pkt1.serial, q->serial_floor); // 返回数据包序列号
+            if (packet_queue_keep_played(q, &pkt1, pkts[ret]) < 0) {
+                av_packet_move_ref(pkts[ret], pkt1.pkt); // 转移数据包所有权（零拷贝）
+                packet_pool_put(&q->pool, pkt1.pkt); // 节点壳放回回收池
+            }
+            ret++;
         }
-        else if (!block) { // 非阻塞模式且无数据
-            ret = 0;      // 设置无数据返回值
-            break;        // 退出循环
+
+        if (ret > 0 || !block) // 已取到数据，或非阻塞模式且无数据
+            break;
+
+        packet_queue_record(q, &q->lock_hold, held);
+        if (q->nb_stale) {
+            packet_queue_reclaim(q, 0);  // 空闲时间先回收flush换下的过期数据包
+            held = packet_queue_clock(q);
+            continue;
         }
-        else { // 阻塞模式且无数据可用
-            /* 等待数据到达的条件变量 */
-            SDL_CondWait(q->cond, q->mutex); // 释放锁并进入等待，唤醒时重新加锁
+
+        /* 队列已取空：多余的slab块摘下后解锁归还，释放期间生产者照常入队 */
+        if (q->slab && (n = packet_slab_trim(q->slab, chunks)) > 0) {
+            SDL_UnlockMutex(q->mutex);
+            packet_slab_free_chunks(chunks, n);
+            SDL_LockMutex(q->mutex);
+            held = packet_queue_clock(q);
+            continue;
         }
+
+        /* 阻塞模式且无数据可用：等待数据到达的条件变量 */
+        q->empty_events.fetch_add(1, std::memory_order_relaxed);
+        wait = packet_queue_clock(q);
+        SDL_CondWait(q->cond, q->mutex); // 释放锁并进入等待，唤醒时重新加锁
+        packet_queue_record(q, &q->consumer_wait, wait);
+        held = packet_queue_clock(q);
     }
 
+    packet_queue_record(q, &q->lock_hold, held);
+    if (ret > 0 && q->nb_stale)
+        packet_queue_reclaim(q, PACKET_RECLAIM_CHUNK);  // 顺带回收一小批过期数据包
     SDL_UnlockMutex(q->mutex); // 退出临界区，释放互斥锁
+    if (ret > 0)
+        packet_queue_wake_reader(q); // 降到低水位时唤醒读线程
     return ret; // 返回最终操作状态
 }
 
+/*
+* 从数据包队列获取数据包（线程安全的阻塞/非阻塞操作）
+* 返回值:
+*   <0: 队列已中止
+*    0: 无数据包且非阻塞模式
+*   >0: 成功获取数据包
+*/
+static int packet_queue_get(PacketQueue* q, AVPacket* pkt, int block, int* serial)
+{
+    return packet_queue_get_batch(q, &pkt, 1, block, serial);
+}
+
+/*
+* 丢弃队头n个数据包并让剩余数据包改用新serial（需持有锁，仅互斥模式）
+* 丢弃部分挂入待回收列表由消费者空闲时释放；serial递增后解码器会冲刷内部状态，
+* 效果等同于flush后从保留的第一个包重新读入
+*/
+static void packet_queue_drop_front(PacketQueue *q, int64_t n)
+{
+    AVFifo *list = packet_queue_take_spare(q);
+    MyAVPacketList pkt1;
+
+    n = FFMIN(n, (int64_t)av_fifo_can_read(q->pkt_list));
+    for (int64_t i = 0; i < n; i++) {
+        av_fifo_peek(q->pkt_list, &pkt1, 1, i);
+        q->nb_packets--;
+        q->size -= pkt1.pkt->size + sizeof(pkt1);
+        q->duration -= pkt1.pkt->duration;
+        q->seq_out++;
+        /* 跳过的数据包进入回看缓冲，保持其与队列的连续（超限部分由消费者下次出队时淘汰） */
+        if (q->played && pkt1.pkt->buf && av_fifo_write(q->played, &pkt1, 1) >= 0) {
+            q->played_bytes += pkt1.pkt->size;
+            q->played_duration += pkt1.pkt->duration;
+            continue;
+        }
+        if (!list || av_fifo_write(list, &pkt1, 1) < 0)
+            av_packet_free(&pkt1.pkt);  // 非消费者线程，节点壳不回池
+    }
+    av_fifo_drain2(q->pkt_list, n);     // 节点已转入回看缓冲/待回收批次，整段移出
+    if (list && av_fifo_can_read(list))
+        q->stale[q->nb_stale++] = list;
+    else if (list)
+        q->spare = list;
+
+    /* 剩余数据包（含溢出文件中的）不逐个改写，出队时按序列号下限提升为新serial */
+    packet_queue_next_serial(q);
+    q->serial_floor = q->serial;
+    if (q->kf_index)
+        packet_queue_prune_index(q);
+}
+
+/*
+* 队列内前向seek（视频）：在关键帧索引中找[min_pts, max_pts]内最靠后的关键帧，
+* 丢弃它之前的数据包，读线程无需调用avformat_seek_file
+* 返回值：1成功（*kf_pts为定位到的关键帧时间戳），0目标不在缓冲内
+*/
+static int packet_queue_seek_keyframe(PacketQueue *q, int64_t min_pts, int64_t max_pts, int64_t *kf_pts)
+{
+    KeyframeEntry kf, found = { AV_NOPTS_VALUE, -1 };
+
+    if (q->spsc || !q->kf_index)
+        return 0;
+
+    SDL_LockMutex(q->mutex);
+    packet_queue_prune_index(q);
+    for (size_t i = 0; av_fifo_peek(q->kf_index, &kf, 1, i) >= 0; i++) {
+        if (kf.seq >= q->seq_out + (int64_t)av_fifo_can_read(q->pkt_list))
+            break;      // 之后的关键帧在溢出文件中
+        if (kf.pts >= min_pts && kf.pts <= max_pts && kf.pts > found.pts)
+            found = kf;
+    }
+    if (found.seq >= 0 && !q->abort_request) {
+        packet_queue_drop_front(q, found.seq - q->seq_out);
+        *kf_pts = found.pts;
+    } else {
+        found.seq = -1;
+    }
+    SDL_UnlockMutex(q->mutex);
+    return found.seq >= 0;
+}
+
+/*
+* 队列内前向seek（音频/字幕）：丢弃时间戳早于pts的队头数据包，
+* 但保留覆盖pts的那个包（最后一个早于pts的包），即使队列中没有pts之后的数据包也不会整队清空
+* require非0时，若队列中没有pts之后的数据包则不做任何修改并返回0
+*/
+static int packet_queue_seek_pts(PacketQueue *q, int64_t pts, int require)
+{
+    MyAVPacketList pkt1;
+    size_t n = 0;
+    int64_t cover = -1;     // 最后一个早于pts的包
+    int found = 0, exact = 0;
+
+    if (q->spsc)
+        return 0;
+
+    SDL_LockMutex(q->mutex);
+    for (; av_fifo_peek(q->pkt_list, &pkt1, 1, n) >= 0; n++) {
+        int64_t ts = packet_queue_pkt_ts(pkt1.pkt);
+        if (ts == AV_NOPTS_VALUE)
+            continue;
+        if (ts >= pts) {
+            found = 1;
+            exact = ts == pts;  // 恰好从pts开始的包本身就覆盖目标
+            break;
+        }
+        cover = n;
+    }
+    if (cover >= 0 && !exact)
+        n = cover;
+    if ((found || !require) && !q->abort_request)
+        packet_queue_drop_front(q, n);
+    else
+        found = 0;
+    SDL_UnlockMutex(q->mutex);
+    return found || !require;
+}
+
+/*
+* 把回看缓冲中from之后的数据包放回队列头部（需持有锁，仅互斥模式）
+* 回放部分与队列中原有数据包一起改用新serial，关键帧索引与入队序号同步前移；
+* 读线程的解复用位置不变，回放完后自然接上原有缓冲
+*/
+static int packet_queue_unplay(PacketQueue *q, size_t from)
+{
+    size_t total = av_fifo_can_read(q->played), n = total - from, live = av_fifo_can_read(q->pkt_list);
+    size_t nb_index = 0;
+    AVFifo *list = av_fifo_alloc2(n + live + 1, sizeof(MyAVPacketList), AV_FIFO_FLAG_AUTO_GROW);
+    MyAVPacketList pkt1;
+
+    if (!list)
+        return AVERROR(ENOMEM);
+    if (q->kf_index) {
+        packet_queue_prune_index(q);
+        if (av_fifo_grow2(q->kf_index, n) < 0)
+            av_fifo_reset2(q->kf_index);   // 索引不完整只影响队列内seek命中率
+        nb_index = av_fifo_can_read(q->kf_index);
+    }
+
+    packet_queue_next_serial(q);
+    /* played = [保留部分 回放部分]：先把保留部分轮转到末尾，再取出回放部分 */
+    for (size_t i = 0; i < from; i++) {
+        av_fifo_read(q->played, &pkt1, 1);
+        av_fifo_write(q->played, &pkt1, 1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        av_fifo_read(q->played, &pkt1, 1);
+        pkt1.serial = q->serial;
+        av_fifo_write(list, &pkt1, 1);
+        q->played_bytes -= pkt1.pkt->size;
+        q->played_duration -= pkt1.pkt->duration;
+        q->nb_packets++;
+        q->size += pkt1.pkt->size + sizeof(pkt1);
+        q->duration += pkt1.pkt->duration;
+        if (q->kf_index && (pkt1.pkt->flags & AV_PKT_FLAG_KEY)) {
+            KeyframeEntry kf = { packet_queue_pkt_ts(pkt1.pkt), q->seq_out - (int64_t)(n - i) };
+            if (kf.pts != AV_NOPTS_VALUE)
+                av_fifo_write(q->kf_index, &kf, 1);
+        }
+    }
+    q->seq_out -= n;
+    /* 原有索引项排到回放部分之后 */
+    for (size_t i = 0; i < nb_index; i++) {
+        KeyframeEntry kf;
+        av_fifo_read(q->kf_index, &kf, 1);
+        av_fifo_write(q->kf_index, &kf, 1);
+    }
+
+    while (av_fifo_read(q->pkt_list, &pkt1, 1) >= 0) {
+        pkt1.serial = q->serial;
+        av_fifo_write(list, &pkt1, 1);
+    }
+    if (!q->spare)
+        q->spare = q->pkt_list;
+    else
+        av_fifo_freep2(&q->pkt_list);
+    q->pkt_list = list;
+    SDL_CondSignal(q->cond);    // 消费者可能正因队列空而等待
+    return 0;
+}
+
+/* 回看缓冲中pts不超过max_pts的最后一个关键帧（需持有锁），返回其下标，没有时返回-1 */
+static int packet_queue_played_keyframe(PacketQueue *q, int64_t max_pts, int64_t *kf_pts)
+{
+    MyAVPacketList pkt1;
+    int64_t best = AV_NOPTS_VALUE;
+    int from = -1;
+
+    for (size_t i = 0; av_fifo_peek(q->played, &pkt1, 1, i) >= 0; i++) {
+        int64_t ts = packet_queue_pkt_ts(pkt1.pkt);
+        if ((pkt1.pkt->flags & AV_PKT_FLAG_KEY) && ts != AV_NOPTS_VALUE && ts <= max_pts && ts > best) {
+            best = ts;
+            from = (int)i;
+        }
+    }
+    *kf_pts = best;
+    return from;
+}
+
+/* 回看缓冲中最后一个不晚于pts的数据包（需持有锁），返回其下标，没有时返回-1 */
+static int packet_queue_played_at(PacketQueue *q, int64_t pts)
+{
+    MyAVPacketList pkt1;
+    int from = -1;
+
+    for (size_t i = 0; av_fifo_peek(q->played, &pkt1, 1, i) >= 0; i++) {
+        int64_t ts = packet_queue_pkt_ts(pkt1.pkt);
+        if (ts != AV_NOPTS_VALUE && ts <= pts)
+            from = (int)i;
+    }
+    return from;
+}
+
+/*
+* 向后seek（视频，可带音频）：视频回到pts不超过max_pts的最后一个关键帧，
+* 音频回到不晚于该关键帧的最后一个数据包，两路都命中才把数据包放回队列头部。
+* 两个队列同时持锁（先视频后音频），探测与提交之间不会被消费者改动回看缓冲；aq可为NULL
+* 返回值：1命中（*kf_pts为视频关键帧时间戳），0回看缓冲未覆盖目标
+*/
+static int packet_queue_rewind_keyframe(PacketQueue *vq, int64_t max_pts, int64_t *kf_pts,
+                                        PacketQueue *aq, AVRational v_tb, AVRational a_tb)
+{
+    int vfrom, afrom = -1, hit = 0;
+
+    if (vq->spsc || !vq->played || (aq && (aq->spsc || !aq->played)))
+        return 0;
+
+    SDL_LockMutex(vq->mutex);
+    if (aq)
+        SDL_LockMutex(aq->mutex);
+    vfrom = packet_queue_played_keyframe(vq, max_pts, kf_pts);
+    if (vfrom >= 0 && aq)
+        afrom = packet_queue_played_at(aq, av_rescale_q(*kf_pts, v_tb, a_tb));
+    if (vfrom >= 0 && (!aq || afrom >= 0) && !vq->abort_request && (!aq || !aq->abort_request) &&
+        packet_queue_unplay(vq, vfrom) >= 0) {
+        hit = 1;
+        if (aq)
+            packet_queue_unplay(aq, afrom);    // 只在内存不足时失败，音频按原缓冲继续、由时钟同步追上
+    }
+    if (aq)
+        SDL_UnlockMutex(aq->mutex);
+    SDL_UnlockMutex(vq->mutex);
+    return hit;
+}
+
+/*
+* 向后seek（音频/字幕）：从回看缓冲中最后一个不晚于pts的数据包开始回放
+* require非0时要求回看缓冲覆盖到pts，否则不做修改并返回0；
+* require为0且没有不晚于pts的数据包时（字幕），回看缓冲中的数据包都在pts之后，全部回放
+*/
+static int packet_queue_rewind_pts(PacketQueue *q, int64_t pts, int require)
+{
+    int from;
+
+    if (q->spsc || !q->played)
+        return !require;
+
+    SDL_LockMutex(q->mutex);
+    from = packet_queue_played_at(q, pts);
+    if (from < 0 && require) {
+        SDL_UnlockMutex(q->mutex);
+        return 0;
+    }
+    if (!q->abort_request && packet_queue_unplay(q, FFMAX(from, 0)) < 0)
+        from = -1;
+    SDL_UnlockMutex(q->mutex);
+    return from >= 0 || !require;
+}
+
 /* 解码器初始化函数（资源绑定与状态准备） */
 static int decoder_init(Decoder* d, AVCodecContext* avctx, PacketQueue* queue, SDL_cond* empty_queue_cond)
 {
@@ -755,6 +2706,13 @@ static int decoder_init(Decoder* d, AVCodecContext* avctx, PacketQueue* queue, S
     d->start_pts = AV_NOPTS_VALUE;  // 初始化为无效时间戳（0x8000000000000000）
     d->pkt_serial = -1;             // 初始序列号设为无效值（防旧数据干扰）
 
+    /* 批量取包缓存 */
+    d->batch_size = av_clip(packet_batch_size, 1, PACKET_BATCH_MAX);
+    for (int i = 0; d->batch_size > 1 && i < d->batch_size; i++) {
+        if (!(d->batch[i] = av_packet_alloc()))
+            return AVERROR(ENOMEM);
+    }
+
     return 0;  // 返回初始化成功状态
 }
 
@@ -795,6 +2753,415 @@ static int decoder_reorder_pts = -1;
  *    - 检测数据包序列号变更时刷新解码器
  *    - 保证解码器状态与当前数据流一致
  */
+/* 解码器取包：优先消费本地批量缓存，缓存耗尽时一次取回一批
+* 返回值与packet_queue_get一致（<0表示队列中止）
+*/
+static int decoder_get_packet(Decoder *d)
+{
+    if (d->batch_size <= 1)
+        return packet_queue_get(d->queue, d->pkt, 1, &d->pkt_serial);
+
+    if (d->queue->abort_request)
+        return -1;
+    if (d->batch_pos >= d->batch_nb) {
+        int n = packet_queue_get_batch(d->queue, d->batch, d->batch_size, 1, d->batch_serial);
+        if (n < 0)
+            return -1;
+        d->batch_nb = n;
+        d->batch_pos = 0;
+    }
+    av_packet_move_ref(d->pkt, d->batch[d->batch_pos]);
+    d->pkt_serial = d->batch_serial[d->batch_pos++];
+    return 1;
+}
+
+/*------------------------------- 共享工作线程池 ------------------------------*/
+
+/* 执行批次中的第job个任务 */
+static void worker_pool_run_job(PoolBatch *b, int job, int slot)
+{
+    int r;
+
+    switch (b->kind) {
+    case 0:
+        r = ((int (*)(AVCodecContext *, void *))b->func)((AVCodecContext *)b->ctx, (uint8_t *)b->arg + (size_t)job * b->size);
+        break;
+    case 1:
+        r = ((int (*)(AVCodecContext *, void *, int, int))b->func)((AVCodecContext *)b->ctx, b->arg, job, slot);
+        break;
+    default:
+        r = ((avfilter_action_func *)b->func)((AVFilterContext *)b->ctx, b->arg, job, b->count);
+        break;
+    }
+    if (b->ret)
+        b->ret[job] = r;
+}
+
+/* 参与一个批次：领取任务直到领完，记入阶段统计 */
+static void worker_pool_drain(WorkerPool *pool, PoolBatch *b, int slot)
+{
+    int64_t start = av_gettime_relative();
+    int n = 0;
+
+    for (int job; (job = b->next.fetch_add(1)) < b->count; n++)
+        worker_pool_run_job(b, job, slot);
+    if (n) {
+        pool->stats[b->stage].jobs.fetch_add(n, std::memory_order_relaxed);
+        pool->stats[b->stage].busy_us.fetch_add(av_gettime_relative() - start, std::memory_order_relaxed);
+    }
+}
+
+static int worker_pool_thread(void *arg)
+{
+    WorkerPool *pool = (WorkerPool *)arg;
+
+    SDL_LockMutex(pool->mutex);
+    while (!pool->quit) {
+        PoolBatch *b;
+        int slot;
+
+        for (b = pool->batches; b; b = b->link)
+            if (b->next.load() < b->count && b->slots < b->max_slots)
+                break;
+        if (!b) {
+            SDL_CondWait(pool->work_cond, pool->mutex);
+            continue;
+        }
+        slot = b->slots++;
+        b->active++;
+        SDL_UnlockMutex(pool->mutex);
+
+        worker_pool_drain(pool, b, slot);
+
+        SDL_LockMutex(pool->mutex);
+        if (!--b->active)
+            SDL_CondBroadcast(pool->done_cond);   // 最后一次访问批次，调用线程可以返回
+    }
+    SDL_UnlockMutex(pool->mutex);
+    return 0;
+}
+
+/* 发布批次并参与执行，返回时所有任务都已完成 */
+static void worker_pool_submit(WorkerPool *pool, PoolBatch *b)
+{
+    pool->stats[b->stage].batches.fetch_add(1, std::memory_order_relaxed);
+    if (b->count <= 1 || b->max_slots <= 1) {
+        worker_pool_drain(pool, b, 0);      // 单任务或不允许并发时直接在调用线程执行
+        return;
+    }
+
+    SDL_LockMutex(pool->mutex);
+    b->slots = 1;                           // 调用线程占用0号
+    b->active = 0;
+    b->link = pool->batches;
+    pool->batches = b;
+    SDL_CondBroadcast(pool->work_cond);
+    SDL_UnlockMutex(pool->mutex);
+
+    worker_pool_drain(pool, b, 0);
+
+    SDL_LockMutex(pool->mutex);
+    for (PoolBatch **p = &pool->batches; *p; p = &(*p)->link) {
+        if (*p == b) {
+            *p = b->link;
+            break;
+        }
+    }
+    while (b->active)
+        SDL_CondWait(pool->done_cond, pool->mutex);
+    SDL_UnlockMutex(pool->mutex);
+}
+
+static int worker_pool_codec_stage(const AVCodecContext *avctx)
+{
+    return avctx->codec_type == AVMEDIA_TYPE_AUDIO ? POOL_STAGE_AUDIO :
+           avctx->codec_type == AVMEDIA_TYPE_SUBTITLE ? POOL_STAGE_SUBTITLE : POOL_STAGE_VIDEO;
+}
+
+/* AVCodecContext.execute */
+static int worker_pool_execute(AVCodecContext *c, int (*func)(AVCodecContext *c2, void *arg), void *arg, int *ret, int count, int size)
+{
+    PoolBatch b = {};
+
+    b.kind = 0;
+    b.ctx = c;
+    b.func = (void *)func;
+    b.arg = arg;
+    b.ret = ret;
+    b.size = size;
+    b.count = count;
+    b.stage = worker_pool_codec_stage(c);
+    b.max_slots = worker_pool->nb_threads + 1;
+    worker_pool_submit(worker_pool, &b);
+    return 0;
+}
+
+/* AVCodecContext.execute2：threadnr必须小于avctx->thread_count */
+static int worker_pool_execute2(AVCodecContext *c, int (*func)(AVCodecContext *c2, void *arg, int jobnr, int threadnr), void *arg, int *ret, int count)
+{
+    PoolBatch b = {};
+
+    b.kind = 1;
+    b.ctx = c;
+    b.func = (void *)func;
+    b.arg = arg;
+    b.ret = ret;
+    b.count = count;
+    b.stage = worker_pool_codec_stage(c);
+    b.max_slots = FFMIN(FFMAX(c->thread_count, 1), worker_pool->nb_threads + 1);
+    worker_pool_submit(worker_pool, &b);
+    return 0;
+}
+
+/* AVFilterGraph.execute，阶段记在graph->opaque里 */
+static int worker_pool_filter_execute(AVFilterContext *ctx, avfilter_action_func *func, void *arg, int *ret, int nb_jobs)
+{
+    PoolBatch b = {};
+
+    b.kind = 2;
+    b.ctx = ctx;
+    b.func = (void *)func;
+    b.arg = arg;
+    b.ret = ret;
+    b.count = nb_jobs;
+    b.stage = (int)(intptr_t)ctx->graph->opaque;
+    b.max_slots = worker_pool->nb_threads + 1;
+    worker_pool_submit(worker_pool, &b);
+    return 0;
+}
+
+/* 新建的滤镜图接入共享池（须在添加滤镜之前调用） */
+static void worker_pool_attach_graph(AVFilterGraph *graph, int stage)
+{
+    if (!worker_pool) {
+        graph->nb_threads = filter_nbthreads;
+        return;
+    }
+    graph->execute = worker_pool_filter_execute;
+    graph->opaque = (void *)(intptr_t)stage;
+    graph->nb_threads = worker_pool->nb_threads + 1;
+}
+
+static void worker_pool_destroy(WorkerPool **ppool)
+{
+    WorkerPool *pool = *ppool;
+
+    if (!pool)
+        return;
+    *ppool = NULL;
+    SDL_LockMutex(pool->mutex);
+    pool->quit = 1;
+    SDL_CondBroadcast(pool->work_cond);
+    SDL_UnlockMutex(pool->mutex);
+    for (int i = 0; i < pool->nb_threads; i++)
+        SDL_WaitThread(pool->threads[i], NULL);
+    SDL_DestroyCond(pool->work_cond);
+    SDL_DestroyCond(pool->done_cond);
+    SDL_DestroyMutex(pool->mutex);
+    av_free(pool);
+}
+
+/* 创建共享池，nb_threads<=0时按CPU核数-1（调用线程也参与执行） */
+static int worker_pool_create(WorkerPool **ppool, int nb_threads)
+{
+    WorkerPool *pool = (WorkerPool *)av_mallocz(sizeof(*pool));
+
+    if (!pool)
+        return AVERROR(ENOMEM);
+    if (nb_threads <= 0)
+        nb_threads = av_cpu_count() - 1;
+    nb_threads = av_clip(nb_threads, 1, WORKER_POOL_MAX);
+    pool->mutex = SDL_CreateMutex();
+    pool->work_cond = SDL_CreateCond();
+    pool->done_cond = SDL_CreateCond();
+    pool->start_time = av_gettime_relative();
+    *ppool = pool;
+    if (!pool->mutex || !pool->work_cond || !pool->done_cond) {
+        av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex/SDL_CreateCond(): %s\n", SDL_GetError());
+        worker_pool_destroy(ppool);
+        return AVERROR(ENOMEM);
+    }
+    for (; pool->nb_threads < nb_threads; pool->nb_threads++) {
+        if (!(pool->threads[pool->nb_threads] = SDL_CreateThread(worker_pool_thread, "pool_worker", pool))) {
+            av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread(): %s\n", SDL_GetError());
+            break;
+        }
+    }
+    if (!pool->nb_threads) {
+        worker_pool_destroy(ppool);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+/*------------------------------- 帧延迟追踪 --------------------------------*/
+
+static const char *const latency_stage_names[LAT_NB] = {
+    "total", "packet queue", "decode", "filter", "frame queue", "display wait", "render+present",
+};
+
+/*
+* 记录一个阶段的时间戳，原地写入，不为共享的FrameData复制（每个数据包只在分配时建一份）。
+* 入帧队列前的阶段都在同一条解码链路上依次写入；回看缓冲保留的包重放时各阶段会重新记录，
+* 一包多帧时后出的帧覆盖前者的解码后阶段，只影响统计样本
+*/
+static FrameData *frame_data_stamp(AVBufferRef **ref, int stage)
+{
+    FrameData *fd;
+
+    if (!*ref)
+        return NULL;
+    fd = (FrameData *)(*ref)->data;
+    fd->ts[stage] = av_gettime_relative();
+    return fd;
+}
+
+/* read_thread读出视频包后挂上FrameData并记录demux时间 */
+static void packet_trace_demux(AVPacket *pkt)
+{
+    FrameData *fd;
+
+    if (!pkt->buf || pkt->opaque_ref)
+        return;
+    if (!(pkt->opaque_ref = av_buffer_allocz(sizeof(*fd))))
+        return;
+    fd = (FrameData *)pkt->opaque_ref->data;
+    fd->pkt_pos = pkt->pos;
+    fd->ts[LAT_DEMUX] = av_gettime_relative();
+}
+
+/* 帧已显示：把各阶段耗时写入样本环（缺失的阶段不计入） */
+static void latency_trace_add(LatencyTrace *lt, const FrameData *fd)
+{
+    for (int i = 0; i < LAT_NB; i++) {
+        int64_t from = fd->ts[i ? i - 1 : LAT_DEMUX], to = fd->ts[i ? i : LAT_PRESENTED];
+
+        if (!from || !to)
+            continue;
+        lt->samples[i][lt->pos[i]] = to - from;
+        lt->pos[i] = (lt->pos[i] + 1) % LATENCY_TRACE_FRAMES;
+        lt->nb[i] = FFMIN(lt->nb[i] + 1, LATENCY_TRACE_FRAMES);
+    }
+    lt->frames++;
+}
+
+static int latency_cmp(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* 某一项在最近样本中的百分位（us），无样本时返回-1 */
+static int64_t latency_trace_percentile(const LatencyTrace *lt, int stage, double p)
+{
+    int64_t sorted[LATENCY_TRACE_FRAMES];
+    int n = lt->nb[stage];
+
+    if (!n)
+        return -1;
+    memcpy(sorted, lt->samples[stage], n * sizeof(*sorted));   // 未写满时有效样本就在前n个
+    qsort(sorted, n, sizeof(*sorted), latency_cmp);
+    return sorted[FFMIN(n - 1, (int)(p * n))];
+}
+
+/*
+* HEVC流的最高TemporalId：hvcC取numTemporalLayers，Annex B取extradata中SPS的sps_max_sub_layers_minus1
+* 未知时返回6（TemporalId上限），此时只有TemporalId=6的图像才算最高子层
+*/
+static int hevc_max_temporal_id(const AVCodecContext *avctx)
+{
+    const uint8_t *p = avctx->extradata, *end = avctx->extradata + avctx->extradata_size;
+
+    if (avctx->extradata_size > 21 && p[0] == 1)
+        return (p[21] >> 3) & 7 ? ((p[21] >> 3) & 7) - 1 : 6;
+    for (; end - p >= 6; p++) {
+        if (!p[0] && !p[1] && p[2] == 1 && ((p[3] >> 1) & 0x3f) == 33)   // SPS
+            return (p[5] >> 1) & 7;
+    }
+    return 6;
+}
+
+/**
+ * 判断数据包是否只含非参考帧（不会被其他帧引用，送入解码器前丢弃不影响后续解码）
+ * 关键帧一律保留；容器标了disposable的直接丢；H.264看slice的nal_ref_idc；
+ * HEVC的sub-layer non-reference类型（TRAIL_N/TSA_N/STSA_N/RADL_N/RASL_N等偶数类型）
+ * 仍可能被更高子层引用，只有TemporalId为最高子层时才算可丢。其他编码返回0。
+ * 默认开启的解码前丢包（-nopktdrop关闭）、精确seek和2倍以上变速都经过这里
+ */
+static int packet_is_disposable(const AVCodecContext *avctx, const AVPacket *pkt)
+{
+    const uint8_t *p = pkt->data, *end = pkt->data + pkt->size;
+    int h264 = avctx->codec_id == AV_CODEC_ID_H264;
+    int nal_len_size = 0, vcl = 0, max_tid = -1;
+
+    if (pkt->flags & AV_PKT_FLAG_KEY)
+        return 0;
+    if (pkt->flags & AV_PKT_FLAG_DISPOSABLE)
+        return 1;
+    if (!h264 && avctx->codec_id != AV_CODEC_ID_HEVC)
+        return 0;
+
+    /* avcC/hvcC格式extradata以版本号1开头，NAL前是长度字段；否则按Annex B起始码切分 */
+    if (avctx->extradata_size > 0 && avctx->extradata[0] == 1) {
+        if (h264 && avctx->extradata_size > 4)
+            nal_len_size = (avctx->extradata[4] & 3) + 1;
+        else if (!h264 && avctx->extradata_size > 21)
+            nal_len_size = (avctx->extradata[21] & 3) + 1;
+        else
+            return 0;
+    }
+
+    while (p < end) {
+        const uint8_t *nal;
+        int64_t size = 0;
+
+        if (nal_len_size) {
+            if (end - p < nal_len_size)
+                return 0;
+            for (int i = 0; i < nal_len_size; i++)
+                size = (size << 8) | *p++;
+            if (size > end - p)
+                return 0;
+            nal = p;
+            p += size;
+        } else {
+            while (end - p >= 3 && (p[0] || p[1] || p[2] != 1))
+                p++;
+            if (end - p < 3)
+                break;
+            nal = p += 3;
+            while (end - p >= 3 && (p[0] || p[1] || p[2] != 1))
+                p++;
+            if (end - p < 3)
+                p = end;
+            size = p - nal;
+        }
+        if (size < 2)
+            continue;
+
+        if (h264) {
+            int type = nal[0] & 0x1f;
+            if (type >= 1 && type <= 5) {       // slice / 数据分区 / IDR
+                if (nal[0] & 0x60)
+                    return 0;
+                vcl = 1;
+            }
+        } else {
+            int type = (nal[0] >> 1) & 0x3f;
+            if (type < 32) {                    // VCL
+                if (type > 14 || (type & 1))
+                    return 0;
+                if (max_tid < 0)
+                    max_tid = hevc_max_temporal_id(avctx);
+                if ((nal[1] & 7) - 1 < max_tid)  // 低子层的非参考帧仍被高子层引用
+                    return 0;
+                vcl = 1;
+            }
+        }
+    }
+    return vcl;
+}
+
 static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
     int ret = AVERROR(EAGAIN); // 初始状态需要输入数据
 
@@ -812,6 +3179,8 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
                 case AVMEDIA_TYPE_VIDEO:
                     ret = avcodec_receive_frame(d->avctx, frame);
                     if (ret >= 0) {
+                        if (latency_trace)
+                            frame_data_stamp(&frame->opaque_ref, LAT_DECODED);
                         // 视频时间戳处理策略
                         if (decoder_reorder_pts == -1) {
                             frame->pts = frame->best_effort_timestamp; // 自动选择最佳PTS
@@ -870,8 +3239,10 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
             } else {
                 /* 从队列获取新数据包 */
                 int old_serial = d->pkt_serial;
-                if (packet_queue_get(d->queue, d->pkt, 1, &d->pkt_serial) < 0)
+                int64_t wait_start = av_gettime_relative();
+                if (decoder_get_packet(d) < 0)
                     return -1; // 队列中止
+                d->wait_us += av_gettime_relative() - wait_start;
 
                 /* 检测序列号变更 (如seek操作后) */
                 if (old_serial != d->pkt_serial) {
@@ -889,6 +3260,12 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
             av_packet_unref(d->pkt); // 丢弃过期序列号的数据包
         } while (1);
 
+        /* 解码前丢包（如视频落后时丢弃非参考帧），省掉整帧的解码开销 */
+        if (d->drop_packet && d->pkt->data && d->drop_packet(d->drop_opaque, d->pkt)) {
+            av_packet_unref(d->pkt);
+            continue;
+        }
+
         /*>>>>>>>>>>>> 阶段3：处理不同类型数据包 <<<<<<<<<<<<*/
         if (d->avctx->codec_type == AVMEDIA_TYPE_SUBTITLE) {
             /* 字幕解码特殊处理 */
@@ -914,6 +3291,8 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
                 fd = (FrameData*)d->pkt->opaque_ref->data;
                 fd->pkt_pos = d->pkt->pos;
             }
+            if (latency_trace && d->avctx->codec_type == AVMEDIA_TYPE_VIDEO)
+                frame_data_stamp(&d->pkt->opaque_ref, LAT_SEND);
 
             /* 音视频数据包送入解码器 */
             if (avcodec_send_packet(d->avctx, d->pkt) == AVERROR(EAGAIN)) {
@@ -931,9 +3310,465 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
 //解码器销毁
 static void decoder_destroy(Decoder *d) {
     av_packet_free(&d->pkt);
+    for (int i = 0; i < PACKET_BATCH_MAX; i++)
+        av_packet_free(&d->batch[i]);
     avcodec_free_context(&d->avctx);
 }
 
+/*------------------------------- GOP并行解码 --------------------------------*/
+
+static void decode_unit_free(DecodeUnit *u)
+{
+    for (int i = 0; i < u->nb_pkts; i++)
+        av_packet_free(&u->pkts[i]);
+    for (int i = 0; i < u->nb_frames; i++)
+        av_frame_free(&u->frames[i]);
+    av_free(u->pkts);
+    av_free(u->frames);
+    av_free(u);
+}
+
+/* 把一个AVPacket/AVFrame指针追加到动态数组 */
+static int decode_unit_append(void ***array, int *nb, int *alloc, void *item)
+{
+    if (*nb == *alloc) {
+        int n = FFMAX(4, *alloc * 2);
+        void **tmp = (void **)av_realloc_array(*array, n, sizeof(**array));
+        if (!tmp)
+            return AVERROR(ENOMEM);
+        *array = tmp;
+        *alloc = n;
+    }
+    (*array)[(*nb)++] = item;
+    return 0;
+}
+
+/* 分发线程把单元挂到链表尾，在途单元达到上限时等待 */
+static void gop_decoder_post(GopDecoder *gd, DecodeUnit *u)
+{
+    SDL_LockMutex(gd->mutex);
+    while (gd->nb_units >= gd->max_units && !gd->abort)
+        SDL_CondWait(gd->cond, gd->mutex);
+    if (gd->abort) {
+        SDL_UnlockMutex(gd->mutex);
+        decode_unit_free(u);
+        return;
+    }
+    if (gd->tail)
+        gd->tail->next = u;
+    else
+        gd->head = u;
+    gd->tail = u;
+    gd->nb_units++;
+    SDL_CondBroadcast(gd->cond);
+    SDL_UnlockMutex(gd->mutex);
+}
+
+static int gop_dispatch_thread(void *arg)
+{
+    GopDecoder *gd = (GopDecoder *)arg;
+    AVPacket *pkt = av_packet_alloc();
+    DecodeUnit *u = NULL;
+    int serial;
+
+    while (pkt) {
+        if (gd->queue->nb_packets == 0)
+            SDL_CondSignal(gd->empty_queue_cond);
+        if (packet_queue_get(gd->queue, pkt, 1, &serial) < 0)
+            break;
+        /* 序列号变化、流结束或遇到新关键帧时，当前单元已完整 */
+        if (u && (serial != u->serial || !pkt->data || (pkt->flags & AV_PKT_FLAG_KEY))) {
+            gop_decoder_post(gd, u);
+            u = NULL;
+        }
+        if (!u && !(u = (DecodeUnit *)av_mallocz(sizeof(*u))))
+            break;
+        u->serial = serial;
+        if (!pkt->data) {
+            u->eof = 1;
+            u->state = DECODE_UNIT_DONE;
+            av_packet_unref(pkt);
+        } else {
+            AVPacket *p = av_packet_alloc();
+            if (!p || decode_unit_append((void ***)&u->pkts, &u->nb_pkts, &u->pkts_alloc, p) < 0) {
+                av_packet_free(&p);
+                break;
+            }
+            av_packet_move_ref(p, pkt);
+            if (!p->opaque_ref && p->buf && (p->opaque_ref = av_buffer_allocz(sizeof(FrameData))))
+                ((FrameData *)p->opaque_ref->data)->pkt_pos = p->pos;
+        }
+        if (u->eof || !gd->key_units) {
+            gop_decoder_post(gd, u);
+            u = NULL;
+        }
+    }
+    if (u)
+        decode_unit_free(u);
+    av_packet_free(&pkt);
+
+    /* 队列中止：唤醒等待单元的解码线程和video_thread */
+    SDL_LockMutex(gd->mutex);
+    gd->abort = 1;
+    SDL_CondBroadcast(gd->cond);
+    SDL_UnlockMutex(gd->mutex);
+    return 0;
+}
+
+/**
+ * 收取解码器当前能输出的全部帧，逐帧交给video_thread
+ * 已解码未交付的帧达到上限时等待；队首单元的帧已全部取走时不等，保证总能前进
+ * @return 0成功，AVERROR_EXIT表示单元已因seek/中止作废
+ */
+static int gop_receive_frames(GopDecoder *gd, AVCodecContext *avctx, DecodeUnit *u)
+{
+    for (;;) {
+        AVFrame *frame = av_frame_alloc();
+        int ret, stale;
+
+        if (!frame)
+            return AVERROR(ENOMEM);
+        if ((ret = avcodec_receive_frame(avctx, frame)) < 0) {
+            av_frame_free(&frame);
+            return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+        }
+        if (decoder_reorder_pts == -1)
+            frame->pts = frame->best_effort_timestamp;
+        else if (!decoder_reorder_pts)
+            frame->pts = frame->pkt_dts;
+        if (latency_trace)
+            frame_data_stamp(&frame->opaque_ref, LAT_DECODED);
+
+        SDL_LockMutex(gd->mutex);
+        if ((ret = decode_unit_append((void ***)&u->frames, &u->nb_frames, &u->frames_alloc, frame)) >= 0) {
+            gd->nb_frames++;
+            SDL_CondBroadcast(gd->cond);
+        }
+        while (ret >= 0 && gd->nb_frames >= gd->max_frames && !gd->abort && u->serial == gd->queue->serial &&
+               !(u == gd->head && u->next_frame == u->nb_frames))
+            SDL_CondWait(gd->cond, gd->mutex);
+        stale = gd->abort || u->serial != gd->queue->serial;
+        SDL_UnlockMutex(gd->mutex);
+        if (ret < 0) {
+            av_frame_free(&frame);
+            return ret;
+        }
+        if (stale)
+            return AVERROR_EXIT;
+    }
+}
+
+/* 解码一个单元：送入全部包后冲刷，解码器回到初始状态以便领取下一个单元 */
+static void gop_decode_unit(GopDecoder *gd, AVCodecContext *avctx, DecodeUnit *u)
+{
+    int ret = 0;
+
+    for (int i = 0; i < u->nb_pkts && ret >= 0; i++) {
+        if (latency_trace)
+            frame_data_stamp(&u->pkts[i]->opaque_ref, LAT_SEND);
+        ret = avcodec_send_packet(avctx, u->pkts[i]);
+        if (ret == AVERROR_INVALIDDATA)
+            ret = 0;    // 单个损坏的包不影响单元内其余包
+        if (ret >= 0)
+            ret = gop_receive_frames(gd, avctx, u);
+    }
+    if (ret >= 0 && avcodec_send_packet(avctx, NULL) >= 0)
+        ret = gop_receive_frames(gd, avctx, u);
+    avcodec_flush_buffers(avctx);
+    if (ret == AVERROR_EXIT) {
+        gd->stale.fetch_add(1, std::memory_order_relaxed);  // 解码中途seek，剩余部分不再解码
+        ret = 0;
+    } else if (ret < 0) {
+        char err[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret, err, sizeof(err));
+        av_log(avctx, AV_LOG_WARNING, "GOP unit decode failed: %s\n", err);
+    }
+    gd->units.fetch_add(1, std::memory_order_relaxed);
+    gd->frames.fetch_add(u->nb_frames, std::memory_order_relaxed);
+}
+
+static int gop_worker_thread(void *arg)
+{
+    struct GopDecoder::GopWorker *w = (struct GopDecoder::GopWorker *)arg;
+    GopDecoder *gd = w->gd;
+
+    SDL_LockMutex(gd->mutex);
+    while (!gd->abort) {
+        DecodeUnit *u = gd->head;
+
+        while (u && u->state != DECODE_UNIT_PENDING)
+            u = u->next;
+        if (!u) {
+            SDL_CondWait(gd->cond, gd->mutex);
+            continue;
+        }
+        u->state = DECODE_UNIT_BUSY;
+        SDL_UnlockMutex(gd->mutex);
+
+        if (u->serial == gd->queue->serial)
+            gop_decode_unit(gd, w->avctx, u);
+        else
+            gd->stale.fetch_add(1, std::memory_order_relaxed);  // seek后作废，不再解码
+
+        SDL_LockMutex(gd->mutex);
+        u->state = DECODE_UNIT_DONE;
+        SDL_CondBroadcast(gd->cond);
+    }
+    SDL_UnlockMutex(gd->mutex);
+    return 0;
+}
+
+/**
+ * video_thread取下一帧（按单元顺序）
+ * @return 1取到帧，0当前序列号的流结束，-1中止
+ */
+static int gop_decoder_get_frame(GopDecoder *gd, AVFrame *frame, int *serial)
+{
+    int ret = -1;
+
+    SDL_LockMutex(gd->mutex);
+    while (!gd->abort && !gd->queue->abort_request) {
+        DecodeUnit *u = gd->head;
+
+        if (!u) {
+            SDL_CondWait(gd->cond, gd->mutex);
+            continue;
+        }
+        /* 队首单元解码中也可以取走已输出的帧 */
+        if (u->serial == gd->queue->serial && u->next_frame < u->nb_frames) {
+            av_frame_move_ref(frame, u->frames[u->next_frame]);
+            av_frame_free(&u->frames[u->next_frame++]);
+            gd->nb_frames--;
+            SDL_CondBroadcast(gd->cond);
+            *serial = u->serial;
+            ret = 1;
+            break;
+        }
+        if (u->state != DECODE_UNIT_DONE) {
+            SDL_CondWait(gd->cond, gd->mutex);
+            continue;
+        }
+        /* 单元已取完或已过期：出链并让出一个在途名额和未取走帧的额度 */
+        if (!(gd->head = u->next))
+            gd->tail = NULL;
+        gd->nb_units--;
+        gd->nb_frames -= u->nb_frames - u->next_frame;
+        SDL_CondBroadcast(gd->cond);
+        if (u->eof && u->serial == gd->queue->serial) {
+            *serial = u->serial;
+            ret = 0;
+            decode_unit_free(u);
+            break;
+        }
+        decode_unit_free(u);
+    }
+    SDL_UnlockMutex(gd->mutex);
+    return ret;
+}
+
+/* 队列serial变化或中止时唤醒等待帧额度/队首单元的线程（在队列锁内调用） */
+static void gop_decoder_wake(void *opaque)
+{
+    GopDecoder *gd = (GopDecoder *)opaque;
+
+    SDL_LockMutex(gd->mutex);
+    SDL_CondBroadcast(gd->cond);
+    SDL_UnlockMutex(gd->mutex);
+}
+
+/* 停止分发/解码线程并释放所有单元与解码器上下文（队列须已中止） */
+static void gop_decoder_free(GopDecoder **pgd)
+{
+    GopDecoder *gd = *pgd;
+
+    if (!gd)
+        return;
+    *pgd = NULL;
+    SDL_LockMutex(gd->queue->mutex);
+    if (gd->queue->serial_opaque == gd) {
+        gd->queue->serial_cb = NULL;
+        gd->queue->serial_opaque = NULL;
+    }
+    SDL_UnlockMutex(gd->queue->mutex);
+    if (gd->mutex) {
+        SDL_LockMutex(gd->mutex);
+        gd->abort = 1;
+        SDL_CondBroadcast(gd->cond);
+        SDL_UnlockMutex(gd->mutex);
+    }
+    SDL_WaitThread(gd->dispatcher, NULL);
+    for (int i = 0; i < gd->nb_workers; i++) {
+        SDL_WaitThread(gd->workers[i].tid, NULL);
+        avcodec_free_context(&gd->workers[i].avctx);
+    }
+    while (gd->head) {
+        DecodeUnit *u = gd->head;
+        gd->head = u->next;
+        decode_unit_free(u);
+    }
+    SDL_DestroyCond(gd->cond);
+    SDL_DestroyMutex(gd->mutex);
+    av_free(gd);
+}
+
+/* 该流能否按帧/封闭GOP切分并行解码（帧内编码或声明了-gop_closed，且不用硬件解码） */
+static int gop_decoder_supported(const AVCodecContext *avctx)
+{
+    const AVCodecDescriptor *desc = avcodec_descriptor_get(avctx->codec_id);
+
+    return ((desc && (desc->props & AV_CODEC_PROP_INTRA_ONLY)) || gop_closed) && !avctx->hw_device_ctx;
+}
+
+/**
+ * 为已打开的视频解码器创建nb个并行解码上下文（单线程解码，共用帧缓冲池）
+ * @return 0成功，AVERROR(ENOSYS)表示该流不适合GOP并行（调用方回退到普通解码）
+ */
+static int gop_decoder_create(GopDecoder **pgd, AVCodecContext *main_ctx, const AVCodecParameters *par,
+                              PacketQueue *queue, SDL_cond *empty_queue_cond, int nb)
+{
+    const AVCodecDescriptor *desc = avcodec_descriptor_get(main_ctx->codec_id);
+    int intra_only = desc && (desc->props & AV_CODEC_PROP_INTRA_ONLY);
+    GopDecoder *gd;
+    int ret;
+
+    if (!gop_decoder_supported(main_ctx))
+        return AVERROR(ENOSYS);
+    if (!(gd = (GopDecoder *)av_mallocz(sizeof(*gd))))
+        return AVERROR(ENOMEM);
+    *pgd = gd;
+    gd->queue = queue;
+    gd->empty_queue_cond = empty_queue_cond;
+    gd->key_units = !intra_only;
+    gd->max_units = av_clip(nb, 1, GOP_PARALLEL_MAX) + 2;
+    gd->max_frames = av_clip(nb, 1, GOP_PARALLEL_MAX) * GOP_FRAMES_PER_WORKER;
+    if (!(gd->mutex = SDL_CreateMutex()) || !(gd->cond = SDL_CreateCond())) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (; gd->nb_workers < av_clip(nb, 1, GOP_PARALLEL_MAX); gd->nb_workers++) {
+        AVCodecContext *avctx = avcodec_alloc_context3(main_ctx->codec);
+        gd->workers[gd->nb_workers].gd = gd;
+        gd->workers[gd->nb_workers].avctx = avctx;
+        if (!avctx) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        if ((ret = avcodec_parameters_to_context(avctx, par)) < 0)
+            goto fail;
+        avctx->pkt_timebase = main_ctx->pkt_timebase;
+        avctx->lowres = main_ctx->lowres;
+        avctx->flags = main_ctx->flags;
+        avctx->flags2 = main_ctx->flags2;
+        avctx->thread_count = 1;    // 并行度来自多个上下文
+        avctx->opaque = main_ctx->opaque;           // 共用帧缓冲池（其get_buffer2线程安全）
+        avctx->get_buffer2 = main_ctx->get_buffer2;
+        if ((ret = avcodec_open2(avctx, main_ctx->codec, NULL)) < 0)
+            goto fail;
+    }
+    return 0;
+fail:
+    gop_decoder_free(pgd);
+    return ret;
+}
+
+/* 启动分发与解码线程（decoder_init之后、video_thread启动之前调用） */
+static int gop_decoder_start(GopDecoder *gd)
+{
+    for (int i = 0; i < gd->nb_workers; i++) {
+        if (!(gd->workers[i].tid = SDL_CreateThread(gop_worker_thread, "gop_decoder", &gd->workers[i]))) {
+            av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread(): %s\n", SDL_GetError());
+            return AVERROR(ENOMEM);
+        }
+    }
+    if (!(gd->dispatcher = SDL_CreateThread(gop_dispatch_thread, "gop_dispatch", gd))) {
+        av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread(): %s\n", SDL_GetError());
+        return AVERROR(ENOMEM);
+    }
+    /* 等待中的线程靠serial变化唤醒，不必定时复查 */
+    SDL_LockMutex(gd->queue->mutex);
+    gd->queue->serial_cb = gop_decoder_wake;
+    gd->queue->serial_opaque = gd;
+    SDL_UnlockMutex(gd->queue->mutex);
+    return 0;
+}
+
+/*------------------------------- 解码降级控制 --------------------------------*/
+
+static const struct {
+    const char *name;
+    enum AVDiscard loop_filter, idct, frame;
+} degrade_levels[DEGRADE_LEVELS] = {
+    { "full decode",               AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+    { "skip non-ref loop filter",  AVDISCARD_NONREF,  AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+    { "skip loop filter",          AVDISCARD_ALL,     AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+    { "skip non-ref idct",         AVDISCARD_ALL,     AVDISCARD_NONREF,  AVDISCARD_DEFAULT },
+    { "skip non-ref frames",       AVDISCARD_ALL,     AVDISCARD_NONREF,  AVDISCARD_NONREF  },
+};
+
+/* 记录用户设置的初始值，降级时在其基础上取较强者 */
+static void degrade_controller_init(DegradeController *dc, const AVCodecContext *avctx)
+{
+    memset(dc, 0, sizeof(*dc));
+    dc->base_loop_filter = avctx->skip_loop_filter;
+    dc->base_idct = avctx->skip_idct;
+    dc->base_frame = avctx->skip_frame;
+    dc->max_level = DEGRADE_LEVELS - 1;
+}
+
+/* 切换级别（视频解码线程调用，与解码调用同线程，不需要加锁） */
+static void degrade_controller_set(DegradeController *dc, Decoder *d, int level, int64_t now)
+{
+    AVCodecContext *avctx = d->avctx;
+
+    av_log(NULL, AV_LOG_INFO, "Decode degradation %d -> %d (%s): load=%.0f%% drops=%d/s\n",
+           dc->level, level, degrade_levels[level].name, dc->load * 100, dc->window_drops);
+    avctx->skip_loop_filter = FFMAX(dc->base_loop_filter, degrade_levels[level].loop_filter);
+    avctx->skip_idct = FFMAX(dc->base_idct, degrade_levels[level].idct);
+    avctx->skip_frame = FFMAX(dc->base_frame, degrade_levels[level].frame);
+    dc->level = level;
+    dc->last_change = now;
+    dc->over_since = dc->under_since = 0;
+    dc->window_drops = 0;
+    dc->changes++;
+}
+
+/**
+ * 每输出一帧调用一次
+ * @param work           本帧解码+滤镜耗时(秒)
+ * @param frame_duration 帧时长(秒)
+ * @param drops          累计丢帧数（早丢+晚丢）
+ */
+static void degrade_controller_update(DegradeController *dc, Decoder *d, double work, double frame_duration, int drops)
+{
+    int64_t now = av_gettime_relative();
+    int overloaded, headroom;
+
+    if (dc->last_update)
+        dc->time_at[dc->level] += now - dc->last_update;
+    dc->last_update = now;
+    if (now - dc->window_start >= 1000000) {
+        dc->window_drops = dc->window_start ? drops - dc->window_base : 0;
+        dc->window_base = drops;
+        dc->window_start = now;
+    }
+    if (frame_duration <= 0 || work < 0)
+        return;     // 帧率未知，或时钟异常
+    work = FFMIN(work, 1.0);    // 超过1秒的样本按1秒计，严重卡顿不再当作异常丢弃
+    dc->load += (work / frame_duration - dc->load) / 16;
+
+    overloaded = dc->load > DEGRADE_HIGH_LOAD || dc->window_drops > 2;
+    headroom = dc->load < DEGRADE_LOW_LOAD && !dc->window_drops;
+    dc->over_since = overloaded ? (dc->over_since ? dc->over_since : now) : 0;
+    dc->under_since = headroom ? (dc->under_since ? dc->under_since : now) : 0;
+
+    if (dc->over_since && dc->level < dc->max_level &&
+        now - dc->over_since >= DEGRADE_UP_DELAY && now - dc->last_change >= DEGRADE_UP_DELAY)
+        degrade_controller_set(dc, d, dc->level + 1, now);
+    else if (dc->under_since && dc->level > 0 &&
+             now - dc->under_since >= DEGRADE_DOWN_DELAY && now - dc->last_change >= DEGRADE_DOWN_DELAY)
+        degrade_controller_set(dc, d, dc->level - 1, now);
+}
+
 //释放帧队列中单个帧项持有的资源
 static void frame_queue_unref_item(Frame *vp)
 {
@@ -951,7 +3786,8 @@ static void frame_queue_unref_item(Frame *vp)
  * 初始化帧队列结构
  * @param f         队列容器
  * @param pktq      关联的数据包队列(用于状态同步)
- * @param max_size  请求的最大容量(实际取FRAME_QUEUE_SIZE最小值)
+ * @param max_size  初始容量
+ * @param capacity  分配的槽位数(自适应扩容上限，小于max_size时取max_size)
  * @param keep_last 是否保留最后显示的帧(用于暂停时画面保持)
  * @return 0成功，AVERROR错误码失败
  *
@@ -960,10 +3796,10 @@ static void frame_queue_unref_item(Frame *vp)
  * 2. 预分配AVFrame内存避免解码时动态分配
  * 3. 使用!!keep_last确保标志位为0/1
  */
-static int frame_queue_init(FrameQueue *f, PacketQueue *pktq, int max_size, int keep_last)
+static int frame_queue_init(FrameQueue *f, PacketQueue *pktq, int max_size, int capacity, int keep_last)
 {
     int i;
-    memset(f, 0, sizeof(FrameQueue));
+    new (f) FrameQueue();   // 值初始化（含原子成员，不能memset）
     if (!(f->mutex = SDL_CreateMutex())) {
         av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex(): %s\n", SDL_GetError());
         return AVERROR(ENOMEM);
@@ -973,9 +3809,13 @@ static int frame_queue_init(FrameQueue *f, PacketQueue *pktq, int max_size, int
         return AVERROR(ENOMEM);
     }
     f->pktq = pktq;
-    f->max_size = FFMIN(max_size, FRAME_QUEUE_SIZE);
+    // keep_last队列常驻一帧已显示的帧，至少要再有一个空位
+    f->max_size = f->base_size = f->peak_size = av_clip(max_size, keep_last ? 2 : 1, FRAME_QUEUE_MAX_SIZE);
+    f->capacity = av_clip(capacity, f->max_size, FRAME_QUEUE_MAX_SIZE);
     f->keep_last = !!keep_last;
-    for (i = 0; i < f->max_size; i++)
+    if (!(f->queue = (Frame *)av_calloc(f->capacity, sizeof(*f->queue))))
+        return AVERROR(ENOMEM);
+    for (i = 0; i < f->capacity; i++)
         if (!(f->queue[i].frame = av_frame_alloc()))
             return AVERROR(ENOMEM);
     return 0;
@@ -993,11 +3833,12 @@ static int frame_queue_init(FrameQueue *f, PacketQueue *pktq, int max_size, int
 static void frame_queue_destroy(FrameQueue *f)
 {
     int i;
-    for (i = 0; i < f->max_size; i++) {
+    for (i = 0; f->queue && i < f->capacity; i++) {
         Frame* vp = &f->queue[i];
         frame_queue_unref_item(vp);
         av_frame_free(&vp->frame);
     }
+    av_freep(&f->queue);
     SDL_DestroyMutex(f->mutex);
     SDL_DestroyCond(f->cond);
 }
@@ -1024,7 +3865,7 @@ static void frame_queue_signal(FrameQueue *f)
 static Frame* frame_queue_peek(FrameQueue* f)
 {
     // 计算逻辑: (读索引 + 显示状态) % 容量
-    return &f->queue[(f->rindex + f->rindex_shown) % f->max_size];
+    return &f->queue[(f->rindex.load(std::memory_order_relaxed) + f->rindex_shown) % f->capacity];
 }
 
 /**
@@ -1034,7 +3875,7 @@ static Frame* frame_queue_peek(FrameQueue* f)
 static Frame* frame_queue_peek_next(FrameQueue* f)
 {
     // 计算逻辑: (读索引 + 显示状态 + 1) % 容量
-    return &f->queue[(f->rindex + f->rindex_shown + 1) % f->max_size];
+    return &f->queue[(f->rindex.load(std::memory_order_relaxed) + f->rindex_shown + 1) % f->capacity];
 }
 
 /**
@@ -1043,7 +3884,21 @@ static Frame* frame_queue_peek_next(FrameQueue* f)
  */
 static Frame* frame_queue_peek_last(FrameQueue* f)
 {
-    return &f->queue[f->rindex];
+    return &f->queue[f->rindex.load(std::memory_order_relaxed)];
+}
+
+/**
+ * 唤醒对端（仅当有线程登记了等待）
+ * size的修改与waiting的读取均为顺序一致操作，和等待方“登记后复查”配对，
+ * 保证要么等待方看到新的size，要么这里看到登记并在锁内唤醒
+ */
+static void frame_queue_wake(FrameQueue* f)
+{
+    if (f->waiting.load()) {
+        SDL_LockMutex(f->mutex);
+        SDL_CondSignal(f->cond);
+        SDL_UnlockMutex(f->mutex);
+    }
 }
 
 /**
@@ -1051,24 +3906,28 @@ static Frame* frame_queue_peek_last(FrameQueue* f)
  * @return 可写入的帧指针，NULL表示队列已中止
  *
  * @同步机制:
- * 1. 加锁检查队列大小
- * 2. 当队列满时条件等待
+ * 1. 无锁检查队列大小，有空位直接返回
+ * 2. 队列满时登记等待，加锁复查后条件等待
  * 3. 写索引循环使用环形缓冲区
  */
 static Frame* frame_queue_peek_writable(FrameQueue* f)
 {
     /* wait until we have space to put a new frame */
-    SDL_LockMutex(f->mutex);
-    while (f->size >= f->max_size &&
-        !f->pktq->abort_request) {
-        SDL_CondWait(f->cond, f->mutex);
+    if (f->size.load(std::memory_order_acquire) >= f->max_size && !f->pktq->abort_request) {
+        SDL_LockMutex(f->mutex);
+        f->waiting.fetch_add(1);
+        while (f->size.load() >= f->max_size &&
+            !f->pktq->abort_request) {
+            SDL_CondWait(f->cond, f->mutex);
+        }
+        f->waiting.fetch_sub(1);
+        SDL_UnlockMutex(f->mutex);
     }
-    SDL_UnlockMutex(f->mutex);
 
     if (f->pktq->abort_request)
         return NULL;
 
-    return &f->queue[f->windex];
+    return &f->queue[f->windex.load(std::memory_order_relaxed)];
 }
 
 /**
@@ -1081,17 +3940,21 @@ static Frame* frame_queue_peek_writable(FrameQueue* f)
 static Frame* frame_queue_peek_readable(FrameQueue* f)
 {
     /* wait until we have a readable a new frame */
-    SDL_LockMutex(f->mutex);
-    while (f->size - f->rindex_shown <= 0 &&
-        !f->pktq->abort_request) {
-        SDL_CondWait(f->cond, f->mutex);
+    if (f->size.load(std::memory_order_acquire) - f->rindex_shown <= 0 && !f->pktq->abort_request) {
+        SDL_LockMutex(f->mutex);
+        f->waiting.fetch_add(1);
+        while (f->size.load() - f->rindex_shown <= 0 &&
+            !f->pktq->abort_request) {
+            SDL_CondWait(f->cond, f->mutex);
+        }
+        f->waiting.fetch_sub(1);
+        SDL_UnlockMutex(f->mutex);
     }
-    SDL_UnlockMutex(f->mutex);
 
     if (f->pktq->abort_request)
         return NULL;
 
-    return &f->queue[(f->rindex + f->rindex_shown) % f->max_size];
+    return &f->queue[(f->rindex.load(std::memory_order_relaxed) + f->rindex_shown) % f->capacity];
 }
 
 /*------------------------------- 队列操作 --------------------------------*/
@@ -1100,17 +3963,15 @@ static Frame* frame_queue_peek_readable(FrameQueue* f)
  * 提交新帧到队列
  * @操作流程:
  * 1. 写索引循环递增
- * 2. 加锁更新队列大小
- * 3. 发送条件信号唤醒读线程
+ * 2. 原子递增队列大小（发布帧内容）
+ * 3. 仅当读线程在等待时才加锁唤醒
  */
 static void frame_queue_push(FrameQueue* f)
 {
-    if (++f->windex == f->max_size)
-        f->windex = 0;
-    SDL_LockMutex(f->mutex);
-    f->size++;
-    SDL_CondSignal(f->cond);
-    SDL_UnlockMutex(f->mutex);
+    int windex = f->windex.load(std::memory_order_relaxed) + 1;
+    f->windex.store(windex == f->capacity ? 0 : windex, std::memory_order_release);
+    f->size.fetch_add(1);
+    frame_queue_wake(f);
 }
 
 /**
@@ -1128,15 +3989,47 @@ static void frame_queue_next(FrameQueue* f)
         f->rindex_shown = 1;
         return;
     }
-    frame_queue_unref_item(&f->queue[f->rindex]);
-    if (++f->rindex == f->max_size)
-        f->rindex = 0;
-    SDL_LockMutex(f->mutex);
-    f->size--;
-    SDL_CondSignal(f->cond);
-    SDL_UnlockMutex(f->mutex);
+    int rindex = f->rindex.load(std::memory_order_relaxed);
+    frame_queue_unref_item(&f->queue[rindex]);
+    f->rindex.store(++rindex == f->capacity ? 0 : rindex, std::memory_order_release);
+    f->size.fetch_sub(1);   // 归还槽位（顺序一致，与生产者的登记等待配对）
+    frame_queue_wake(f);
 }
 
+/**
+ * 按单帧生产耗时（解码+滤镜，不含等待队列空位）的抖动自适应调整容量上限
+ * @param work           本帧生产耗时(秒)
+ * @param frame_duration 帧时长(秒)
+ *
+ * @策略:
+ * 目标深度 = base_size + ceil(2σ / 帧时长)，均值超过帧时长时再加1帧；
+ * 扩容立即生效，缩容每帧最多减1，限制在[base_size, capacity]
+ */
+static void frame_queue_adapt(FrameQueue* f, double work, double frame_duration)
+{
+    double d;
+    int target;
+
+    if (f->capacity <= f->base_size || frame_duration <= 0 || work < 0)
+        return;     // 未开启自适应，或时钟异常
+    work = FFMIN(work, 1.0);    // 超过1秒的样本按1秒计，长时间卡顿仍推动扩容
+    d = work - f->work_mean;
+    f->work_mean += d / 16;
+    f->work_var += (d * d - f->work_var) / 16;
+    target = f->base_size + (int)ceil(2 * sqrt(f->work_var) / frame_duration) + (f->work_mean > frame_duration);
+    target = av_clip(target, f->base_size, f->capacity);
+    if (target == f->max_size)
+        return;
+
+    // 仅由生产者线程调用，之后的frame_queue_peek_writable直接按新上限判断
+    if (target > f->max_size) {
+        f->max_size = target;
+        f->peak_size = FFMAX(f->peak_size, target);
+    } else {
+        f->max_size--;
+    }
+}
+
 /*------------------------------- 帧队列状态查询 ------------------------------*/
 
 /**
@@ -1154,7 +4047,7 @@ static void frame_queue_next(FrameQueue* f)
  */
 static int frame_queue_nb_remaining(FrameQueue* f)
 {
-    return f->size - f->rindex_shown;
+    return f->size.load(std::memory_order_acquire) - f->rindex_shown;
 }
 
 /**
@@ -1173,7 +4066,7 @@ static int frame_queue_nb_remaining(FrameQueue* f)
  */
 static int64_t frame_queue_last_pos(FrameQueue* f)
 {
-    Frame* fp = &f->queue[f->rindex];
+    Frame* fp = &f->queue[f->rindex.load(std::memory_order_relaxed)];
     // 双重验证保证位置有效性
     if (f->rindex_shown && fp->serial == f->pktq->serial)
         return fp->pos;
@@ -1181,6 +4074,524 @@ static int64_t frame_queue_last_pos(FrameQueue* f)
         return -1; // 无效位置标识
 }
 
+/*------------------------------- 设备PCM环 --------------------------------*/
+
+/* 分配至少min_size字节的环（向上取2的幂） */
+static int pcm_ring_init(PcmRing *r, int min_size)
+{
+    int size = 1;
+
+    while (size < min_size)
+        size <<= 1;
+    if (!(r->buf = (uint8_t *)av_malloc(size)))
+        return AVERROR(ENOMEM);
+    if (!(r->space = SDL_CreateSemaphore(0))) {
+        av_log(NULL, AV_LOG_FATAL, "SDL_CreateSemaphore(): %s\n", SDL_GetError());
+        return AVERROR(ENOMEM);
+    }
+    r->size = size;
+    r->wpos = 0;
+    r->rpos = 0;
+    r->mark_w = 0;
+    r->mark_r = 0;
+    r->last_pts = NAN;
+    r->last_speed = 1.0;
+    r->last_serial = -1;
+    r->waiting = 0;
+    r->abort = 0;
+    r->underruns = 0;
+    return 0;
+}
+
+static void pcm_ring_destroy(PcmRing *r)
+{
+    av_freep(&r->buf);
+    if (r->space)
+        SDL_DestroySemaphore(r->space);
+    r->space = NULL;
+}
+
+/* 中止：唤醒等待空间的生产者 */
+static void pcm_ring_abort(PcmRing *r)
+{
+    if (!r->space)
+        return;
+    r->abort = 1;
+    SDL_SemPost(r->space);
+}
+
+/* 消费者：腾出空间后，生产者已登记等待时唤醒一次（无等待者时只有一次原子读） */
+static void pcm_ring_wake_producer(PcmRing *r)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);   // 与生产者“登记后复查”配对，避免漏唤醒
+    if (r->waiting.load(std::memory_order_relaxed) && r->waiting.exchange(0))
+        SDL_SemPost(r->space);
+}
+
+/* 环中未读出的字节数 */
+static int pcm_ring_fill(PcmRing *r)
+{
+    return (int)(r->wpos.load(std::memory_order_acquire) - r->rpos.load(std::memory_order_acquire));
+}
+
+/**
+ * 生产者：写入一段PCM，空间不足时等待
+ * 超过半个环的段拆成多次写入，每次各带一个标记，pts_end按拆分位置和倍速回推
+ * @return 0成功，<0已中止
+ */
+static int pcm_ring_write(PcmRing *r, const uint8_t *data, int len, double pts_end, int serial,
+                          int bytes_per_sec, double speed)
+{
+    while (len > 0) {
+        int64_t w = r->wpos.load(std::memory_order_relaxed);
+        int64_t mw = r->mark_w.load(std::memory_order_relaxed);
+        int space = r->size - (int)(w - r->rpos.load(std::memory_order_acquire));
+        int n = FFMIN(len, r->size / 2);
+        int off, first;
+        PcmMark *m;
+
+        if (r->abort)
+            return -1;
+        if (space < n || mw - r->mark_r.load(std::memory_order_acquire) >= PCM_RING_MARKS) {
+            r->waiting.store(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            // 登记后复查：回调可能在登记前已腾出空间
+            if (!r->abort && (r->size - (int)(w - r->rpos.load(std::memory_order_acquire)) < n ||
+                              mw - r->mark_r.load(std::memory_order_acquire) >= PCM_RING_MARKS))
+                SDL_SemWait(r->space);
+            r->waiting.store(0);
+            continue;
+        }
+        off = (int)(w & (r->size - 1));
+        first = FFMIN(n, r->size - off);
+        memcpy(r->buf + off, data, first);
+        memcpy(r->buf, data + first, n - first);
+
+        m = &r->marks[mw & (PCM_RING_MARKS - 1)];
+        m->end = w + n;
+        m->pts = isnan(pts_end) ? NAN : pts_end - (double)(len - n) / bytes_per_sec * speed;
+        m->speed = speed;
+        m->serial = serial;
+        // 先发布数据再发布标记：消费者看到标记时其覆盖的数据一定可读
+        r->wpos.store(w + n, std::memory_order_release);
+        r->mark_w.store(mw + 1, std::memory_order_release);
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* 消费者：跳过开头序列号已过期（seek前）的段 */
+static void pcm_ring_drop_stale(PcmRing *r, int serial)
+{
+    int64_t mw = r->mark_w.load(std::memory_order_acquire);
+    int64_t mr = r->mark_r.load(std::memory_order_relaxed), mr0 = mr;
+
+    while (mr < mw && r->marks[mr & (PCM_RING_MARKS - 1)].serial != serial) {
+        r->rpos.store(FFMAX(r->rpos.load(std::memory_order_relaxed), r->marks[mr & (PCM_RING_MARKS - 1)].end),
+                      std::memory_order_release);
+        mr++;
+    }
+    r->mark_r.store(mr, std::memory_order_release);
+    if (mr != mr0)
+        pcm_ring_wake_producer(r);
+}
+
+/* 消费者：取出最多len字节的可读区域，环回绕时分成两段，用完后调用pcm_ring_consume */
+static int pcm_ring_peek(PcmRing *r, int len, uint8_t **p1, int *n1, uint8_t **p2, int *n2)
+{
+    int64_t rd = r->rpos.load(std::memory_order_relaxed);
+    int n = FFMIN(len, pcm_ring_fill(r));
+    int off = (int)(rd & (r->size - 1));
+
+    *p1 = r->buf + off;
+    *n1 = FFMIN(n, r->size - off);
+    *p2 = r->buf;
+    *n2 = n - *n1;
+    return n;
+}
+
+static void pcm_ring_consume(PcmRing *r, int n)
+{
+    int64_t rd = r->rpos.load(std::memory_order_relaxed) + n;
+    int64_t mw = r->mark_w.load(std::memory_order_acquire);
+    int64_t mr = r->mark_r.load(std::memory_order_relaxed);
+
+    while (mr < mw && r->marks[mr & (PCM_RING_MARKS - 1)].end <= rd) {
+        r->last_pts = r->marks[mr & (PCM_RING_MARKS - 1)].pts;
+        r->last_speed = r->marks[mr & (PCM_RING_MARKS - 1)].speed;
+        r->last_serial = r->marks[mr & (PCM_RING_MARKS - 1)].serial;
+        mr++;
+    }
+    r->mark_r.store(mr, std::memory_order_release);
+    r->rpos.store(rd, std::memory_order_release);
+    if (n)
+        pcm_ring_wake_producer(r);
+}
+
+/* 消费者：读位置（即下一个送往设备的样本）对应的时间及该处的倍速 */
+static double pcm_ring_clock(PcmRing *r, int *serial, double *speed, int bytes_per_sec)
+{
+    int64_t mr = r->mark_r.load(std::memory_order_relaxed);
+
+    if (mr < r->mark_w.load(std::memory_order_acquire)) {
+        const PcmMark *m = &r->marks[mr & (PCM_RING_MARKS - 1)];
+        *serial = m->serial;
+        *speed = m->speed;
+        return m->pts - (double)(m->end - r->rpos.load(std::memory_order_relaxed)) / bytes_per_sec * m->speed;
+    }
+    *serial = r->last_serial;
+    *speed = r->last_speed;
+    return r->last_pts;
+}
+
+/*------------------------------- 音量增益内核 --------------------------------*/
+
+/* 单遍把src乘以增益写入dst，增益从g线性变化，每个样本增加step（step=0时为固定增益）
+* 取代回调里memset+SDL_MixAudioFormat的两遍处理；音量只会衰减，S16仍做饱和保护
+* n为样本数（声道交织计数），src与dst可以相同
+*/
+typedef void (*AudioGainFunc)(void *dst, const void *src, int n, float g, float step);
+
+static void audio_gain_s16_c(void *dst, const void *src, int n, float g, float step)
+{
+    const int16_t *s = (const int16_t *)src;
+    int16_t *d = (int16_t *)dst;
+
+    for (int i = 0; i < n; i++)
+        d[i] = av_clip_int16(lrintf(s[i] * (g + step * i)));
+}
+
+static void audio_gain_f32_c(void *dst, const void *src, int n, float g, float step)
+{
+    const float *s = (const float *)src;
+    float *d = (float *)dst;
+
+    for (int i = 0; i < n; i++)
+        d[i] = s[i] * (g + step * i);
+}
+
+#ifdef GAIN_X86
+GAIN_TARGET("sse2")
+static void audio_gain_s16_sse2(void *dst, const void *src, int n, float g, float step)
+{
+    const int16_t *s = (const int16_t *)src;
+    int16_t *d = (int16_t *)dst;
+    const __m128 ramp_lo = _mm_mul_ps(_mm_set1_ps(step), _mm_setr_ps(0, 1, 2, 3));
+    const __m128 ramp_hi = _mm_mul_ps(_mm_set1_ps(step), _mm_setr_ps(4, 5, 6, 7));
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128 base = _mm_set1_ps(g + step * i);   // 每次按下标重算，避免累加漂移
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+        lo = _mm_mul_ps(lo, _mm_add_ps(base, ramp_lo));
+        hi = _mm_mul_ps(hi, _mm_add_ps(base, ramp_hi));
+        _mm_storeu_si128((__m128i *)(d + i), _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+    }
+    audio_gain_s16_c(d + i, s + i, n - i, g + step * i, step);
+}
+
+GAIN_TARGET("sse2")
+static void audio_gain_f32_sse2(void *dst, const void *src, int n, float g, float step)
+{
+    const float *s = (const float *)src;
+    float *d = (float *)dst;
+    const __m128 ramp = _mm_mul_ps(_mm_set1_ps(step), _mm_setr_ps(0, 1, 2, 3));
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(d + i, _mm_mul_ps(_mm_loadu_ps(s + i), _mm_add_ps(_mm_set1_ps(g + step * i), ramp)));
+    audio_gain_f32_c(d + i, s + i, n - i, g + step * i, step);
+}
+
+GAIN_TARGET("avx2")
+static void audio_gain_s16_avx2(void *dst, const void *src, int n, float g, float step)
+{
+    const int16_t *s = (const int16_t *)src;
+    int16_t *d = (int16_t *)dst;
+    const __m256 ramp_lo = _mm256_mul_ps(_mm256_set1_ps(step), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+    const __m256 ramp_hi = _mm256_mul_ps(_mm256_set1_ps(step), _mm256_setr_ps(8, 9, 10, 11, 12, 13, 14, 15));
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256 base = _mm256_set1_ps(g + step * i);
+        __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(x)));
+        __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1)));
+        lo = _mm256_mul_ps(lo, _mm256_add_ps(base, ramp_lo));
+        hi = _mm256_mul_ps(hi, _mm256_add_ps(base, ramp_hi));
+        // packs按128位通道交错，permute恢复样本顺序
+        x = _mm256_packs_epi32(_mm256_cvtps_epi32(lo), _mm256_cvtps_epi32(hi));
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_permute4x64_epi64(x, 0xD8));
+    }
+    audio_gain_s16_sse2(d + i, s + i, n - i, g + step * i, step);
+}
+
+GAIN_TARGET("avx2")
+static void audio_gain_f32_avx2(void *dst, const void *src, int n, float g, float step)
+{
+    const float *s = (const float *)src;
+    float *d = (float *)dst;
+    const __m256 ramp = _mm256_mul_ps(_mm256_set1_ps(step), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(d + i, _mm256_mul_ps(_mm256_loadu_ps(s + i), _mm256_add_ps(_mm256_set1_ps(g + step * i), ramp)));
+    audio_gain_f32_sse2(d + i, s + i, n - i, g + step * i, step);
+}
+#endif
+
+#ifdef GAIN_NEON
+static void audio_gain_s16_neon(void *dst, const void *src, int n, float g, float step)
+{
+    const int16_t *s = (const int16_t *)src;
+    int16_t *d = (int16_t *)dst;
+    static const float idx_lo[4] = {0, 1, 2, 3}, idx_hi[4] = {4, 5, 6, 7};
+    const float32x4_t ramp_lo = vmulq_n_f32(vld1q_f32(idx_lo), step);
+    const float32x4_t ramp_hi = vmulq_n_f32(vld1q_f32(idx_hi), step);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t x = vld1q_s16(s + i);
+        float32x4_t base = vdupq_n_f32(g + step * i);
+        float32x4_t lo = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), vaddq_f32(base, ramp_lo));
+        float32x4_t hi = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), vaddq_f32(base, ramp_hi));
+        vst1q_s16(d + i, vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(lo)), vqmovn_s32(vcvtnq_s32_f32(hi))));
+    }
+    audio_gain_s16_c(d + i, s + i, n - i, g + step * i, step);
+}
+
+static void audio_gain_f32_neon(void *dst, const void *src, int n, float g, float step)
+{
+    const float *s = (const float *)src;
+    float *d = (float *)dst;
+    static const float idx[4] = {0, 1, 2, 3};
+    const float32x4_t ramp = vmulq_n_f32(vld1q_f32(idx), step);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4)
+        vst1q_f32(d + i, vmulq_f32(vld1q_f32(s + i), vaddq_f32(vdupq_n_f32(g + step * i), ramp)));
+    audio_gain_f32_c(d + i, s + i, n - i, g + step * i, step);
+}
+#endif
+
+/* 把平面格式的各声道交织为打包格式（格式、采样率、布局都与设备一致时代替swr） */
+static void audio_interleave(uint8_t *dst, uint8_t * const *src, int nb_samples, int channels, int bps)
+{
+    if (bps == 4) {
+        uint32_t *d = (uint32_t *)dst;
+        for (int ch = 0; ch < channels; ch++) {
+            const uint32_t *s = (const uint32_t *)src[ch];
+            for (int i = 0; i < nb_samples; i++)
+                d[i * channels + ch] = s[i];
+        }
+    } else if (bps == 2) {
+        uint16_t *d = (uint16_t *)dst;
+        for (int ch = 0; ch < channels; ch++) {
+            const uint16_t *s = (const uint16_t *)src[ch];
+            for (int i = 0; i < nb_samples; i++)
+                d[i * channels + ch] = s[i];
+        }
+    } else {
+        for (int ch = 0; ch < channels; ch++)
+            for (int i = 0; i < nb_samples; i++)
+                memcpy(dst + (i * channels + ch) * bps, src[ch] + i * bps, bps);
+    }
+}
+
+/* 内核表：按优先级从低到高排列，cpu_flag为0表示总是可用 */
+typedef struct AudioGainKernel {
+    const char *name;
+    int cpu_flag;
+    AudioGainFunc s16;
+    AudioGainFunc f32;
+} AudioGainKernel;
+
+static const AudioGainKernel audio_gain_kernels[] = {
+    { "c",    0,                audio_gain_s16_c,    audio_gain_f32_c },
+#ifdef GAIN_X86
+    { "sse2", AV_CPU_FLAG_SSE2, audio_gain_s16_sse2, audio_gain_f32_sse2 },
+    { "avx2", AV_CPU_FLAG_AVX2, audio_gain_s16_avx2, audio_gain_f32_avx2 },
+#endif
+#ifdef GAIN_NEON
+    { "neon", AV_CPU_FLAG_NEON, audio_gain_s16_neon, audio_gain_f32_neon },
+#endif
+};
+
+/* 选出当前CPU支持的最优内核（结果缓存，回调中调用不做检测） */
+static const AudioGainKernel *audio_gain_kernel(void)
+{
+    static std::atomic<const AudioGainKernel *> best{nullptr};
+    const AudioGainKernel *k = best.load(std::memory_order_acquire);
+
+    if (!k) {
+        int flags = av_get_cpu_flags();
+        k = &audio_gain_kernels[0];
+        for (const auto &e : audio_gain_kernels)
+            if (!e.cpu_flag || (flags & e.cpu_flag))
+                k = &e;
+        best.store(k, std::memory_order_release);
+    }
+    return k;
+}
+
+/**
+ * 带增益渐变的拷贝：样本格式为S16或FLT（交织）
+ * 增益为1时直接memcpy，为0时直接清零
+ */
+static void audio_gain_apply(uint8_t *dst, const uint8_t *src, int len, enum AVSampleFormat fmt, float g, float step)
+{
+    const AudioGainKernel *k = audio_gain_kernel();
+    int n = len / av_get_bytes_per_sample(fmt);
+
+    if (step == 0.0f && g == 1.0f)
+        memcpy(dst, src, len);
+    else if (step == 0.0f && g == 0.0f)
+        memset(dst, 0, len);
+    else if (fmt == AV_SAMPLE_FMT_FLT)
+        k->f32(dst, src, n, g, step);
+    else
+        k->s16(dst, src, n, g, step);
+}
+
+/*------------------------------- 解码帧缓冲池 --------------------------------*/
+
+static FramePool *frame_pool_alloc(void)
+{
+    FramePool *fp = (FramePool *)av_mallocz(sizeof(*fp));
+
+    if (!fp)
+        return NULL;
+    if (!(fp->mutex = SDL_CreateMutex())) {
+        av_free(fp);
+        return NULL;
+    }
+    fp->format = -1;
+    return fp;
+}
+
+/* AVBufferPool的分配回调：只在池里没有空闲缓冲时触发 */
+static AVBufferRef *frame_pool_alloc_plane(void *opaque, size_t size)
+{
+    FramePool *fp = (FramePool *)opaque;
+    AVBufferRef *buf = av_buffer_alloc(size);
+
+    if (buf)
+        fp->allocated.fetch_add(1, std::memory_order_relaxed);
+    return buf;
+}
+
+static void frame_pool_uninit(FramePool *fp)
+{
+    for (int i = 0; i < 4; i++)
+        av_buffer_pool_uninit(&fp->pools[i]);
+    fp->nb_planes = 0;
+    fp->format = -1;
+}
+
+/**
+ * 按帧参数重建平面池（持mutex调用）
+ * 行宽先满足解码器的对齐要求(avcodec_align_dimensions2)，再对齐到FRAME_POOL_ALIGN；
+ * 每个缓冲多留对齐余量，取出后把data指针推到对齐地址
+ */
+static int frame_pool_configure(FramePool *fp, AVCodecContext *avctx, const AVFrame *frame)
+{
+    enum AVPixelFormat fmt = (enum AVPixelFormat)frame->format;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    ptrdiff_t linesizes[4];
+    size_t sizes[4];
+    int w = frame->width, h = frame->height;
+    int i, ret, unaligned;
+
+    frame_pool_uninit(fp);
+    avcodec_align_dimensions2(avctx, &w, &h, linesize_align);
+    do {
+        if ((ret = av_image_fill_linesizes(fp->linesize, fmt, w)) < 0)
+            return ret;
+        w += w & ~(w - 1);  // 行宽不满足对齐时按最低位逐步加宽
+        unaligned = 0;
+        for (i = 0; i < 4; i++)
+            unaligned |= fp->linesize[i] % FFMAX(linesize_align[i], FRAME_POOL_ALIGN);
+    } while (unaligned);
+
+    for (i = 0; i < 4; i++)
+        linesizes[i] = fp->linesize[i];
+    if ((ret = av_image_fill_plane_sizes(sizes, fmt, h, linesizes)) < 0)
+        return ret;
+    for (i = 0; i < 4 && sizes[i]; i++) {
+        fp->plane_size[i] = sizes[i];
+        fp->pools[i] = av_buffer_pool_init2(sizes[i] + 16 + FRAME_POOL_ALIGN - 1, fp,
+                                            frame_pool_alloc_plane, NULL);
+        if (!fp->pools[i]) {
+            frame_pool_uninit(fp);
+            return AVERROR(ENOMEM);
+        }
+    }
+    fp->nb_planes = i;
+    fp->width = frame->width;
+    fp->height = frame->height;
+    fp->format = frame->format;
+    fp->reconfigs.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+/**
+ * 视频解码器的get_buffer2回调（avctx->opaque指向FramePool）
+ * 不支持DR1的解码器、硬件帧和调色板格式交给avcodec_default_get_buffer2
+ */
+static int frame_pool_get_buffer2(AVCodecContext *avctx, AVFrame *frame, int flags)
+{
+    FramePool *fp = (FramePool *)avctx->opaque;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((enum AVPixelFormat)frame->format);
+    int i, ret = 0;
+
+    if (!(avctx->codec->capabilities & AV_CODEC_CAP_DR1) || avctx->hw_frames_ctx || !desc ||
+        (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL))) {
+        fp->fallbacks.fetch_add(1, std::memory_order_relaxed);
+        return avcodec_default_get_buffer2(avctx, frame, flags);
+    }
+
+    SDL_LockMutex(fp->mutex);
+    if (frame->width != fp->width || frame->height != fp->height || frame->format != fp->format)
+        ret = frame_pool_configure(fp, avctx, frame);
+    for (i = 0; ret >= 0 && i < fp->nb_planes; i++) {
+        if (!(frame->buf[i] = av_buffer_pool_get(fp->pools[i]))) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        frame->data[i] = (uint8_t *)FFALIGN((uintptr_t)frame->buf[i]->data, FRAME_POOL_ALIGN);
+        frame->linesize[i] = fp->linesize[i];
+    }
+    SDL_UnlockMutex(fp->mutex);
+    fp->plane_gets.fetch_add(i, std::memory_order_relaxed);
+
+    if (ret < 0) {
+        while (i--) {
+            av_buffer_unref(&frame->buf[i]);
+            frame->data[i] = NULL;
+        }
+        return ret;
+    }
+    frame->extended_data = frame->data;
+    fp->frames.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+/* 释放缓冲池：仍被帧引用的缓冲由各自的AVBufferPool在最后一个引用释放时回收 */
+static void frame_pool_free(FramePool **pfp)
+{
+    FramePool *fp = *pfp;
+
+    if (!fp)
+        return;
+    *pfp = NULL;
+    frame_pool_uninit(fp);
+    SDL_DestroyMutex(fp->mutex);
+    av_free(fp);
+}
+
 /*------------------------------- 解码器中止操作 ------------------------------*/
 
 /**
@@ -121,6 +121,63 @@ static void parse_window_size(const char *opt, const char *value)
     screen_height = h;
 }
 
+/*
+* 解析单个水位值：以s结尾表示秒，否则为字节数（可带K/M/G后缀）
+* 返回1表示秒、0表示字节
+*/
+static int parse_watermark_value(const char *opt, const char *token, double *sec, int64_t *bytes)
+{
+    char *end = nullptr;
+    double val = strtod(token, &end);
+    if (end == token || val < 0)
+        option_fail(opt, "Invalid buffer watermark", token);
+    if (!strcmp(end, "s")) {
+        *sec = val;
+        return 1;
+    }
+    double scale = 1;
+    switch (*end) {
+    case 'K': case 'k': scale = 1024;               end++; break;
+    case 'M': case 'm': scale = 1024 * 1024;        end++; break;
+    case 'G': case 'g': scale = 1024 * 1024 * 1024; end++; break;
+    default: break;
+    }
+    if (*end)
+        option_fail(opt, "Invalid buffer watermark", token);
+    *bytes = static_cast<int64_t>(val * scale);
+    return 0;
+}
+
+/* -abuf/-vbuf/-sbuf low:high，可重复指定以分别设置时长和字节水位 */
+static void parse_buffer_watermarks(AVMediaType type, const char *opt, const char *value)
+{
+    if (!value)
+        option_fail(opt, "Missing value");
+    const char *sep = strchr(value, ':');
+    if (!sep)
+        option_fail(opt, "Expected low:high", value);
+    std::string low(value, sep - value), high(sep + 1);
+    double low_sec = 0, high_sec = 0;
+    int64_t low_bytes = 0, high_bytes = 0;
+    int low_is_sec = parse_watermark_value(opt, low.c_str(), &low_sec, &low_bytes);
+    int high_is_sec = parse_watermark_value(opt, high.c_str(), &high_sec, &high_bytes);
+    if (low_is_sec != high_is_sec)
+        option_fail(opt, "Low and high watermarks must use the same unit", value);
+
+    BufferWatermarks *wm = &buffer_watermarks[type];
+    if (low_is_sec) {
+        if (low_sec > high_sec)
+            option_fail(opt, "Low watermark exceeds high watermark", value);
+        wm->low_sec = low_sec;
+        wm->high_sec = high_sec;
+    } else {
+        if (low_bytes > high_bytes || high_bytes <= 0)
+            option_fail(opt, "Invalid byte watermarks", value);
+        wm->low_bytes = low_bytes;
+        wm->high_bytes = high_bytes;
+    }
+}
+
 static std::string format_time_from_us(int64_t us)
 {
     if (us == AV_NOPTS_VALUE)
@@ -379,8 +436,10 @@ static void stream_component_close(VideoState *is, int stream_index)
     {
         case AVMEDIA_TYPE_AUDIO:
         {
+            pcm_ring_abort(&is->audio.pcm);   // audio_thread可能在等环空间
             decoder_abort(&is->audio.auddec, &is->audio.sampq);
             SDL_CloseAudioDevice(audio_dev);
+            pcm_ring_destroy(&is->audio.pcm);
             decoder_destroy(&is->audio.auddec);
             swr_free(&is->audio.swr_ctx);
             av_freep(&is->audio.audio_buf1);
@@ -400,6 +459,11 @@ static void stream_component_close(VideoState *is, int stream_index)
         case AVMEDIA_TYPE_VIDEO:
         {
             decoder_abort(&is->video.viddec, &is->video.pictq);
+            if (show_status && is->video.gop)  // 解码器随流关闭释放，统计在这里输出
+                av_log(NULL, AV_LOG_INFO, "\ngop parallel: %d decoders, units=%" PRId64 " frames=%" PRId64 " stale=%" PRId64 "\n",
+                       is->video.gop->nb_workers, is->video.gop->units.load(), is->video.gop->frames.load(),
+                       is->video.gop->stale.load());
+            gop_decoder_free(&is->video.gop);
             decoder_destroy(&is->video.viddec);
             break;
         }
@@ -434,6 +498,204 @@ static void stream_component_close(VideoState *is, int stream_index)
     }
 }
 
+/* 输出一个等待/持锁时间直方图（样本数、均值、百分位及非空分桶） */
+static void dump_wait_histogram(const char *queue, const char *label, const WaitHistogram *h)
+{
+    int64_t n = wait_histogram_count(h);
+    AVBPrint buf;
+
+    if (!n)
+        return;
+    av_bprint_init(&buf, 0, AV_BPRINT_SIZE_AUTOMATIC);
+    av_bprintf(&buf, "%-9s %-13s n=%" PRId64 " avg=%" PRId64 "us p50<=%" PRId64 "us p99<=%" PRId64 "us max=%" PRId64 "us |",
+               queue, label, n, h->total_us.load() / n, wait_histogram_percentile(h, 0.5),
+               wait_histogram_percentile(h, 0.99), h->max_us.load());
+    for (int i = 0; i < QUEUE_HIST_BUCKETS; i++) {
+        int64_t c = h->count[i].load();
+        if (c)
+            av_bprintf(&buf, " <%" PRId64 "us:%" PRId64, INT64_C(1) << i, c);
+    }
+    av_log(NULL, AV_LOG_INFO, "%s\n", buf.str);
+    av_bprint_finalize(&buf, NULL);
+}
+
+/* 各阶段延迟分位（-trace_latency），“total”为demux到present */
+static void dump_latency_trace(VideoState *is)
+{
+    LatencyTrace *lt = &is->latency;
+
+    if (!lt->frames)
+        return;
+    av_log(NULL, AV_LOG_INFO, "video latency over the last %d of %" PRId64 " frames (ms):\n",
+           lt->nb[0], lt->frames);
+    for (int i = 0; i < LAT_NB; i++) {
+        if (!lt->nb[i])
+            continue;
+        av_log(NULL, AV_LOG_INFO, "  %-15s p50=%7.2f p95=%7.2f p99=%7.2f max=%7.2f\n", latency_stage_names[i],
+               latency_trace_percentile(lt, i, 0.50) / 1000.0,
+               latency_trace_percentile(lt, i, 0.95) / 1000.0,
+               latency_trace_percentile(lt, i, 0.99) / 1000.0,
+               latency_trace_percentile(lt, i, 1.0) / 1000.0);
+    }
+}
+
+/* 音频回调执行时间与欠载次数 */
+static void dump_audio_callback_stats(VideoState *is)
+{
+    const WaitHistogram *h = &is->audio.callback_time;
+    int64_t n = wait_histogram_count(h);
+
+    if (!n)
+        return;
+    av_log(NULL, AV_LOG_INFO, "audio callback: %" PRId64 " calls, avg=%" PRId64 "us p99<=%" PRId64 "us max=%" PRId64 "us, %" PRId64 " underruns\n",
+           n, h->total_us.load() / n, wait_histogram_percentile(h, 0.99), h->max_us.load(), is->audio.pcm.underruns.load());
+}
+
+/* 关键帧快进/快退统计 */
+static void dump_trick_play_stats(VideoState *is)
+{
+    TrickPlay *tp = &is->trick;
+
+    if (!tp->steps)
+        return;
+    av_log(NULL, AV_LOG_INFO, "trick play: %d keyframes shown, avg seek+read %0.1fms, %" PRId64 " packets read\n",
+           tp->steps, tp->step_time / 1000.0 / tp->steps, tp->packets);
+}
+
+/* 倒放统计 */
+static void dump_reverse_stats(VideoState *is)
+{
+    ReversePlay *rp = &is->rev;
+
+    if (!rp->gops_done)
+        return;
+    av_log(NULL, AV_LOG_INFO, "reverse: %d GOPs, %0.1f frames/GOP, GOP decode avg=%0.1fms max=%0.1fms | "
+           "peak cache %" PRId64 "MB (limit %dMB), %" PRId64 " frames thinned\n",
+           rp->gops_done, (double)rp->frames / rp->gops_done, rp->decode_time / 1000.0 / rp->gops_done,
+           rp->decode_max / 1000.0, rp->peak_bytes >> 20, reverse_mem, rp->thinned);
+}
+
+/* 精确seek统计（-accurate_seek） */
+static void dump_accurate_seek_stats(VideoState *is)
+{
+    AccurateSeek *as = &is->aseek;
+
+    if (!as->count)
+        return;
+    av_log(NULL, AV_LOG_INFO, "accurate seek: %d seeks, time to exact frame avg=%0.1fms max=%0.1fms | "
+           "%" PRId64 " frames skipped, %" PRId64 " packets dropped, %" PRId64 " samples trimmed\n",
+           as->count.load(), as->total_time / 1000.0 / as->count, as->max_time / 1000.0,
+           as->video_skipped.load(), as->video_dropped.load(), as->audio_trimmed.load());
+}
+
+/* 降级控制器在各级别的停留时间（-autodegrade） */
+static void dump_degrade_stats(VideoState *is)
+{
+    DegradeController *dc = &is->video.degrade;
+    int64_t total = 0;
+
+    if (!auto_degrade || !dc->changes)
+        return;
+    for (int i = 0; i < DEGRADE_LEVELS; i++)
+        total += dc->time_at[i];
+    av_log(NULL, AV_LOG_INFO, "decode degradation: %d level changes\n", dc->changes);
+    for (int i = 0; i <= dc->max_level; i++)
+        av_log(NULL, AV_LOG_INFO, "  level %d %-25s %8.1fs (%5.1f%%)\n", i, degrade_levels[i].name,
+               dc->time_at[i] / 1000000.0, total > 0 ? 100.0 * dc->time_at[i] / total : 0.0);
+}
+
+/* 退出时输出各数据包队列的运行统计 */
+static void dump_queue_stats(VideoState *is)
+{
+    const struct {
+        const char *name;
+        PacketQueue *q;
+    } queues[] = {
+        { "audioq",    &is->audio.audioq },
+        { "videoq",    &is->video.videoq },
+        { "subtitleq", &is->subtitle.subtitleq },
+    };
+
+    av_log(NULL, AV_LOG_INFO, "\n");
+    for (const auto &e : queues) {
+        if (!e.q->pool.hits && !e.q->pool.misses)
+            continue;   // 未使用过的队列
+        av_log(NULL, AV_LOG_INFO, "%-9s pool: hits=%" PRId64 " misses=%" PRId64 " released=%" PRId64
+               " | flushes=%" PRId64 " stale reclaimed=%" PRId64 "\n",
+               e.name, e.q->pool.hits.load(), e.q->pool.misses.load(), e.q->pool.releases.load(),
+               e.q->flushes.load(), e.q->reclaimed.load());
+        if (e.q->instrument) {
+            av_log(NULL, AV_LOG_INFO, "%-9s empty waits=%" PRId64 " full waits=%" PRId64 "\n",
+                   e.name, e.q->empty_events.load(), e.q->full_events.load());
+            dump_wait_histogram(e.name, "decoder wait", &e.q->consumer_wait);
+            dump_wait_histogram(e.name, "reader wait", &e.q->producer_wait);
+            dump_wait_histogram(e.name, "lock hold", &e.q->lock_hold);
+        }
+        if (e.q->slab)
+            av_log(NULL, AV_LOG_INFO, "%-9s slab: %" PRId64 " packets copied, chunks allocated=%" PRId64 " reused=%" PRId64 "\n",
+                   e.name, e.q->slab->copied.load(), e.q->slab->allocated.load(), e.q->slab->reused.load());
+        if (e.q->spill_w)
+            av_log(NULL, AV_LOG_INFO, "%-9s spill: %" PRId64 " packets written, peak file size %" PRId64 "KB\n",
+                   e.name, e.q->spilled.load(), e.q->spill_peak.load() / 1024);
+        if (e.q->played)
+            av_log(NULL, AV_LOG_INFO, "%-9s rewind: %" PRId64 "KB held (limit %" PRId64 "KB)\n",
+                   e.name, e.q->played_bytes / 1024, e.q->played_max_bytes / 1024);
+        if (e.q->high_bytes > 0)
+            av_log(NULL, AV_LOG_INFO, "%-9s watermarks: %.1fs..%.1fs %" PRId64 "KB..%" PRId64 "KB, rate=%.1fKB/s\n",
+                   e.name, e.q->low_sec, e.q->high_sec, e.q->low_bytes / 1024, e.q->high_bytes / 1024,
+                   packet_queue_input_rate(e.q) / 1024);
+    }
+    if (is->video.frame_drops_early + is->video.frame_drops_late + is->video.frame_drops_pkt)
+        av_log(NULL, AV_LOG_INFO, "video drops: %d packets before decode, %d frames after decode, %d late frames\n",
+               is->video.frame_drops_pkt, is->video.frame_drops_early, is->video.frame_drops_late);
+    if (is->video.frame_skips_rate)
+        av_log(NULL, AV_LOG_INFO, "video skips: %d non-reference packets not decoded at >= %.0fx\n",
+               is->video.frame_skips_rate, PLAYBACK_RATE_SKIP);
+    if (is->audio.frames_direct + is->audio.frames_interleaved + is->audio.frames_swr)
+        av_log(NULL, AV_LOG_INFO, "audio     output %s: %" PRId64 " frames direct, %" PRId64 " interleaved, %" PRId64 " through swr\n",
+               av_get_sample_fmt_name(is->audio.audio_tgt.fmt), is->audio.frames_direct,
+               is->audio.frames_interleaved, is->audio.frames_swr);
+    dump_audio_callback_stats(is);
+    dump_wait_histogram("audio", "callback", &is->audio.callback_time);
+    dump_latency_trace(is);
+    dump_degrade_stats(is);
+    dump_accurate_seek_stats(is);
+    dump_trick_play_stats(is);
+    dump_reverse_stats(is);
+    if (worker_pool) {
+        static const char *const stage_names[POOL_STAGE_NB] = { "audio", "video", "subtitle", "afilter", "vfilter" };
+        double capacity = (double)(av_gettime_relative() - worker_pool->start_time) * (worker_pool->nb_threads + 1);
+        av_log(NULL, AV_LOG_INFO, "shared pool: %d workers + caller\n", worker_pool->nb_threads);
+        for (int i = 0; i < POOL_STAGE_NB; i++) {
+            WorkerStageStats *s = &worker_pool->stats[i];
+            if (!s->batches)
+                continue;
+            av_log(NULL, AV_LOG_INFO, "  %-8s batches=%" PRId64 " jobs=%" PRId64 " busy=%.2fs (%.1f%% of pool)\n",
+                   stage_names[i], s->batches.load(), s->jobs.load(), s->busy_us.load() / 1000000.0,
+                   capacity > 0 ? 100.0 * s->busy_us.load() / capacity : 0.0);
+        }
+    }
+    if (is->video.frame_pool && is->video.frame_pool->frames) {
+        FramePool *fp = is->video.frame_pool;
+        int64_t gets = fp->plane_gets.load(), allocated = fp->allocated.load();
+        size_t frame_size = 0;
+        for (int i = 0; i < fp->nb_planes; i++)
+            frame_size += fp->plane_size[i];
+        av_log(NULL, AV_LOG_INFO, "frame pool: %" PRId64 " frames, planes allocated=%" PRId64 " reused=%" PRId64
+               " | %zuKB/frame, reconfigs=%" PRId64 " fallbacks=%" PRId64 "\n",
+               fp->frames.load(), allocated, gets - allocated, frame_size / 1024,
+               fp->reconfigs.load(), fp->fallbacks.load());
+    }
+    if (is->video.pictq.capacity > is->video.pictq.base_size)
+        av_log(NULL, AV_LOG_INFO, "pictq depth: base=%d peak=%d capacity=%d (frame work avg=%.2fms sd=%.2fms)\n",
+               is->video.pictq.base_size, is->video.pictq.peak_size, is->video.pictq.capacity,
+               is->video.pictq.work_mean * 1000, sqrt(is->video.pictq.work_var) * 1000);
+    av_log(NULL, AV_LOG_INFO, "read thread stalls: %d | seeks: in-buffer=%d demuxer=%d\n",
+           is->read_stalls, is->buffer_seeks, is->demux_seeks);
+    if (is->rewind_hits || is->rewind_misses)
+        av_log(NULL, AV_LOG_INFO, "rewind cache: hits=%d misses=%d\n", is->rewind_hits, is->rewind_misses);
+}
+
 static void stream_close(VideoState *is)
 {
     /* XXX: use a special url_shutdown call to abort parse cleanly */
@@ -448,6 +710,18 @@ static void stream_close(VideoState *is)
     if (is->subtitle_stream >= 0)
         stream_component_close(is, is->subtitle_stream);
 
+    if (show_status)
+        dump_queue_stats(is);
+    else {
+        if (is->audio.pcm.underruns)
+            dump_audio_callback_stats(is);
+        dump_latency_trace(is);
+        dump_degrade_stats(is);
+        dump_accurate_seek_stats(is);
+        dump_trick_play_stats(is);
+        dump_reverse_stats(is);
+    }
+
     avformat_close_input(&is->ic);
 
     packet_queue_destroy(&is->video.videoq);
@@ -458,7 +732,9 @@ static void stream_close(VideoState *is)
     frame_queue_destroy(&is->video.pictq);
     frame_queue_destroy(&is->audio.sampq);
     frame_queue_destroy(&is->subtitle.subpq);
+    frame_pool_free(&is->video.frame_pool);
     SDL_DestroyCond(is->continue_read_thread);
+    SDL_DestroyMutex(is->continue_read_mutex);
     sws_freeContext(is->video.sub_convert_ctx);
     av_free(is->filename);
     if (is->vis.vis_texture)
@@ -483,6 +759,7 @@ static void do_exit(VideoState *is)
     if (is) {
         stream_close(is);
     }
+    worker_pool_destroy(&worker_pool);
     if (renderer)
         SDL_DestroyRenderer(renderer);
     if (vk_renderer)
@@ -501,6 +778,7 @@ static void do_exit(VideoState *is)
         av_freep(&wanted_stream_spec[i]);
     av_freep(&window_title);
     av_freep(&input_filename);
+    av_freep(&spill_dir);
     avformat_network_deinit();
     if (show_status)
         printf("\n");
@@ -576,7 +854,7 @@ static int synchronize_audio(VideoState *is, int nb_samples)
                 avg_diff = is->audio.audio_diff_cum * (1.0 - is->audio.audio_diff_avg_coef);
 
                 if (fabs(avg_diff) >= is->audio.audio_diff_threshold) {
-                    wanted_nb_samples = nb_samples + (int)(diff * is->audio.audio_src.freq);
+                    wanted_nb_samples = nb_samples + (int)(diff / is->audio.filter_rate * is->audio.audio_src.freq);
                     min_nb_samples = ((nb_samples * (100 - SAMPLE_CORRECTION_PERCENT_MAX) / 100));
                     max_nb_samples = ((nb_samples * (100 + SAMPLE_CORRECTION_PERCENT_MAX) / 100));
                     wanted_nb_samples = av_clip(wanted_nb_samples, min_nb_samples, max_nb_samples);
@@ -596,40 +874,47 @@ static int synchronize_audio(VideoState *is, int nb_samples)
     return wanted_nb_samples;
 }
 
-static int audio_decode_frame(VideoState *is)
+/**
+ * 把一帧转换为设备格式（在audio_thread中执行，结果指向is->audio.audio_buf）
+ * @return 转换后的字节数，<0表示失败（该帧丢弃）
+ */
+static int audio_render_frame(VideoState *is, Frame *af)
 {
+    enum AVSampleFormat fmt = static_cast<AVSampleFormat>(af->frame->format);
     int data_size, resampled_data_size;
-    av_unused double audio_clock0;
     int wanted_nb_samples;
-    Frame *af;
-
-    if (is->paused)
-        return -1;
-
-    do {
-#if defined(_WIN32)
-        while (frame_queue_nb_remaining(&is->audio.sampq) == 0) {
-            if ((av_gettime_relative() - audio_callback_time) > 1000000LL * is->audio.audio_hw_buf_size / is->audio.audio_tgt.bytes_per_sec / 2)
-                return -1;
-            av_usleep (1000);
-        }
-#endif
-        if (!(af = frame_queue_peek_readable(&is->audio.sampq)))
-            return -1;
-        frame_queue_next(&is->audio.sampq);
-    } while (af->serial != is->audio.audioq.serial);
+    int direct;
 
     data_size = av_samples_get_buffer_size(NULL, af->frame->ch_layout.nb_channels,
-                                           af->frame->nb_samples,
-                                           static_cast<AVSampleFormat>(af->frame->format), 
-                                           1);
+                                           af->frame->nb_samples, fmt, 1);
 
     wanted_nb_samples = synchronize_audio(is, af->frame->nb_samples);
 
-    if (af->frame->format        != is->audio.audio_src.fmt            ||
+    /* 格式（忽略平面/打包）、采样率、布局都与设备一致且没有同步补偿时不经过swr */
+    direct = av_get_packed_sample_fmt(fmt) == is->audio.audio_tgt.fmt &&
+             af->frame->sample_rate == is->audio.audio_tgt.freq &&
+             !av_channel_layout_compare(&af->frame->ch_layout, &is->audio.audio_tgt.ch_layout) &&
+             wanted_nb_samples == af->frame->nb_samples;
+    if (direct && !is->audio.swr_ctx) {
+        if (!av_sample_fmt_is_planar(fmt)) {
+            is->audio.audio_buf = af->frame->data[0];
+            is->audio.frames_direct++;
+            return data_size;
+        }
+        av_fast_malloc(&is->audio.audio_buf1, &is->audio.audio_buf1_size, data_size);
+        if (!is->audio.audio_buf1)
+            return AVERROR(ENOMEM);
+        audio_interleave(is->audio.audio_buf1, af->frame->extended_data, af->frame->nb_samples,
+                         af->frame->ch_layout.nb_channels, av_get_bytes_per_sample(fmt));
+        is->audio.audio_buf = is->audio.audio_buf1;
+        is->audio.frames_interleaved++;
+        return data_size;
+    }
+
+    if (!is->audio.swr_ctx                                             ||
+        fmt                      != is->audio.audio_src.fmt            ||
         av_channel_layout_compare(&af->frame->ch_layout, &is->audio.audio_src.ch_layout) ||
-        af->frame->sample_rate   != is->audio.audio_src.freq           ||
-        (wanted_nb_samples       != af->frame->nb_samples && !is->audio.swr_ctx)) {
+        af->frame->sample_rate   != is->audio.audio_src.freq) {
         swr_free(&is->audio.swr_ctx);
         swr_alloc_set_opts2(&is->audio.swr_ctx,
                             &is->audio.audio_tgt.ch_layout, is->audio.audio_tgt.fmt, is->audio.audio_tgt.freq,
@@ -638,7 +923,7 @@ static int audio_decode_frame(VideoState *is)
         if (!is->audio.swr_ctx || swr_init(is->audio.swr_ctx) < 0) {
             av_log(NULL, AV_LOG_ERROR,
                    "Cannot create sample rate converter for conversion of %d Hz %s %d channels to %d Hz %s %d channels!\n",
-                    af->frame->sample_rate, av_get_sample_fmt_name(static_cast<AVSampleFormat>(af->frame->format)), af->frame->ch_layout.nb_channels,
+                    af->frame->sample_rate, av_get_sample_fmt_name(fmt), af->frame->ch_layout.nb_channels,
                     is->audio.audio_tgt.freq, av_get_sample_fmt_name(is->audio.audio_tgt.fmt), is->audio.audio_tgt.ch_layout.nb_channels);
             swr_free(&is->audio.swr_ctx);
             return -1;
@@ -646,10 +931,10 @@ static int audio_decode_frame(VideoState *is)
         if (av_channel_layout_copy(&is->audio.audio_src.ch_layout, &af->frame->ch_layout) < 0)
             return -1;
         is->audio.audio_src.freq = af->frame->sample_rate;
-        is->audio.audio_src.fmt = static_cast<AVSampleFormat>(af->frame->format);
+        is->audio.audio_src.fmt = fmt;
     }
 
-    if (is->audio.swr_ctx) {
+    {
         const uint8_t **in = (const uint8_t **)af->frame->extended_data;
         uint8_t **out = &is->audio.audio_buf1;
         int out_count = (int64_t)wanted_nb_samples * is->audio.audio_tgt.freq / af->frame->sample_rate + 256;
@@ -678,31 +963,42 @@ static int audio_decode_frame(VideoState *is)
             av_log(NULL, AV_LOG_WARNING, "audio buffer is probably too small\n");
             if (swr_init(is->audio.swr_ctx) < 0)
                 swr_free(&is->audio.swr_ctx);
+        } else if (direct) {
+            /* 补偿已结束：取出重采样器缓存的尾部样本后关闭swr，后续帧直通 */
+            uint8_t *tail = is->audio.audio_buf1 + len2 * is->audio.audio_tgt.frame_size;
+            int len3 = swr_convert(is->audio.swr_ctx, &tail, out_count - len2, NULL, 0);
+            if (len3 > 0)
+                len2 += len3;
+            swr_free(&is->audio.swr_ctx);
         }
         is->audio.audio_buf = is->audio.audio_buf1;
+        is->audio.frames_swr++;
         resampled_data_size = len2 * is->audio.audio_tgt.ch_layout.nb_channels * av_get_bytes_per_sample(is->audio.audio_tgt.fmt);
-    } else {
-        is->audio.audio_buf = af->frame->data[0];
-        resampled_data_size = data_size;
     }
+    return resampled_data_size;
+}
 
-    audio_clock0 = is->audio_clock;
-    /* update the audio clock with the pts */
-    if (!isnan(af->pts))
-        is->audio_clock = af->pts + (double) af->frame->nb_samples / af->frame->sample_rate;
-    else
-        is->audio_clock = NAN;
-    is->audio_clock_serial = af->serial;
-#ifdef DEBUG
-    {
-        static double last_clock;
-        printf("audio: delay=%0.3f clock=%0.3f clock0=%0.3f\n",
-               is->audio_clock - last_clock,
-               is->audio_clock, audio_clock0);
-        last_clock = is->audio_clock;
+/* audio_thread：取空采样队列，转换后写入PCM环，环满时在这里等待（取代回调里的解码拉取） */
+static int audio_pump(VideoState *is)
+{
+    Frame *af;
+    int size;
+
+    while (frame_queue_nb_remaining(&is->audio.sampq) > 0) {
+        if (!(af = frame_queue_peek_readable(&is->audio.sampq)))
+            return -1;
+        frame_queue_next(&is->audio.sampq);
+        if (af->serial != is->audio.audioq.serial)
+            continue;
+        if ((size = audio_render_frame(is, af)) < 0)
+            continue;
+        /* sampq每入队一帧就在这里取空，帧的倍速即当前滤镜图的倍速 */
+        if (pcm_ring_write(&is->audio.pcm, is->audio.audio_buf, size,
+                           isnan(af->pts) ? NAN : af->pts + af->duration * is->audio.filter_rate,
+                           af->serial, is->audio.audio_tgt.bytes_per_sec, is->audio.filter_rate) < 0)
+            return -1;
     }
-#endif
-    return resampled_data_size;
+    return 0;
 }
 
 /**
@@ -763,17 +1059,22 @@ static void set_default_window_size(int width, int height, AVRational sar)
     default_height = rect.h;
 }
 
-static void update_sample_display(VideoState *is, short *samples, int samples_size)
+static void update_sample_display(VideoState *is, const uint8_t *samples, int samples_size, enum AVSampleFormat fmt)
 {
     int size, len;
 
-    size = samples_size / sizeof(short);
+    size = samples_size / av_get_bytes_per_sample(fmt);
     while (size > 0) {
         len = SAMPLE_ARRAY_SIZE - is->vis.sample_array_index;
         if (len > size)
             len = size;
-        memcpy(is->vis.sample_array + is->vis.sample_array_index, samples, len * sizeof(short));
-        samples += len;
+        if (fmt == AV_SAMPLE_FMT_FLT) {  // 可视化缓存固定为S16
+            const float *f = (const float *)samples;
+            for (int i = 0; i < len; i++)
+                is->vis.sample_array[is->vis.sample_array_index + i] = av_clip_int16(lrintf(f[i] * 32767.0f));
+        } else
+            memcpy(is->vis.sample_array + is->vis.sample_array_index, samples, len * sizeof(short));
+        samples += len * av_get_bytes_per_sample(fmt);
         is->vis.sample_array_index += len;
         if (is->vis.sample_array_index >= SAMPLE_ARRAY_SIZE)
             is->vis.sample_array_index = 0;
@@ -789,47 +1090,55 @@ static void sync_clock_to_slave(Clock *c, Clock *slave)
         set_clock(c, slave_clock, slave->serial);
 }
 
+/* 实时回调：只从PCM环拷贝并缩放音量，数据不足补静音；解码、重采样和同步补偿都在audio_thread */
 static void sdl_audio_callback(void *opaque, Uint8 *stream, int len)
 {
     VideoState *is = reinterpret_cast<VideoState*>(opaque);
-    int audio_size, len1;
+    PcmRing *r = &is->audio.pcm;
+    enum AVSampleFormat fmt = is->audio.audio_tgt.fmt;
+    int bps = av_get_bytes_per_sample(fmt);
+    float gain = is->audio.audio_gain;
+    float target = is->audio.muted ? 0.0f : (float)is->audio.audio_volume / SDL_MIX_MAXVOLUME;
+    float step = (target - gain) / (len / bps);   // 音量/静音变化在本次缓冲内线性渐变，避免爆音
+    uint8_t *src[2];
+    int n[2], got = 0, serial;
+    double clock, speed;
 
     audio_callback_time = av_gettime_relative();
 
-    while (len > 0) {
-        if (is->audio.audio_buf_index >= is->audio.audio_buf_size) {
-           audio_size = audio_decode_frame(is);
-           if (audio_size < 0) {
-                /* if error, just output silence */
-               is->audio.audio_buf = NULL;
-               is->audio.audio_buf_size = SDL_AUDIO_MIN_BUFFER_SIZE / is->audio.audio_tgt.frame_size * is->audio.audio_tgt.frame_size;
-           } else {
-               if (is->show_mode != VideoState::ShowMode::SHOW_MODE_VIDEO)
-                   update_sample_display(is, (int16_t *)is->audio.audio_buf, audio_size);
-               is->audio.audio_buf_size = audio_size;
-           }
-           is->audio.audio_buf_index = 0;
-        }
-        len1 = is->audio.audio_buf_size - is->audio.audio_buf_index;
-        if (len1 > len)
-            len1 = len;
-        if (!is->audio.muted && is->audio.audio_buf && is->audio.audio_volume == SDL_MIX_MAXVOLUME)
-            memcpy(stream, (uint8_t *)is->audio.audio_buf + is->audio.audio_buf_index, len1);
-        else {
-            memset(stream, 0, len1);
-            if (!is->audio.muted && is->audio.audio_buf)
-                SDL_MixAudioFormat(stream, (uint8_t *)is->audio.audio_buf + is->audio.audio_buf_index, AUDIO_S16SYS, len1, is->audio.audio_volume);
-        }
-        len -= len1;
-        stream += len1;
-        is->audio.audio_buf_index += len1;
-    }
-    is->audio.audio_write_buf_size = is->audio.audio_buf_size - is->audio.audio_buf_index;
-    /* Let's assume the audio driver that is used by SDL has two periods. */
-    if (!isnan(is->audio_clock)) {
-        set_clock_at(&is->audclk, is->audio_clock - (double)(2 * is->audio.audio_hw_buf_size + is->audio.audio_write_buf_size) / is->audio.audio_tgt.bytes_per_sec, is->audio_clock_serial, audio_callback_time / 1000000.0);
+    pcm_ring_drop_stale(r, is->audio.audioq.serial);
+    if (!is->paused)
+        got = pcm_ring_peek(r, len, &src[0], &n[0], &src[1], &n[1]);
+    for (int i = 0; got && i < 2; i++) {
+        if (!n[i])
+            continue;
+        audio_gain_apply(stream, src[i], n[i], fmt, gain, step);
+        gain += step * (n[i] / bps);
+        if (is->show_mode != VideoState::ShowMode::SHOW_MODE_VIDEO)
+            update_sample_display(is, src[i], n[i], fmt);
+        stream += n[i];
+    }
+    if (got < len) {
+        /* 只统计播放中途断流：暂停、刚seek尚未出声、播完或快进/倒放静音时的空环不算 */
+        if (!is->paused && r->last_serial == is->audio.audioq.serial &&
+            is->audio.auddec.finished != is->audio.audioq.serial && !is->trick.active && is->rev.serial < 0)
+            r->underruns++;
+        memset(stream, 0, len - got);
+    }
+    pcm_ring_consume(r, got);
+    /* 只推进实际输出的样本：暂停/断流时渐变停在已到达的增益，下次回调接着走完（整段输出时消除累加误差） */
+    is->audio.audio_gain = got == len ? target : gain;
+
+    clock = pcm_ring_clock(r, &serial, &speed, is->audio.audio_tgt.bytes_per_sec);
+    if (!isnan(clock)) {
+        is->audio_clock = clock;
+        is->audio_clock_serial = serial;
+        is->audclk.speed = speed;   // 变速播放：设备里的数据按写入时的倍速换算为媒体时间
+        /* Let's assume the audio driver that is used by SDL has two periods. */
+        set_clock_at(&is->audclk, clock - (double)(2 * is->audio.audio_hw_buf_size) / is->audio.audio_tgt.bytes_per_sec * speed, serial, audio_callback_time / 1000000.0);
         sync_clock_to_slave(&is->extclk, &is->audclk);
     }
+    wait_histogram_add(&is->audio.callback_time, av_gettime_relative() - audio_callback_time);
 }
 
 static int audio_open(void *opaque, AVChannelLayout *wanted_channel_layout, int wanted_sample_rate, struct AudioParams *audio_hw_params)
@@ -860,12 +1169,13 @@ static int audio_open(void *opaque, AVChannelLayout *wanted_channel_layout, int
     }
     while (next_sample_rate_idx && next_sample_rates[next_sample_rate_idx] >= wanted_spec.freq)
         next_sample_rate_idx--;
-    wanted_spec.format = AUDIO_S16SYS;
+    wanted_spec.format = audio_float ? AUDIO_F32SYS : AUDIO_S16SYS;
     wanted_spec.silence = 0;
     wanted_spec.samples = FFMAX(SDL_AUDIO_MIN_BUFFER_SIZE, 2 << av_log2(wanted_spec.freq / SDL_AUDIO_MAX_CALLBACKS_PER_SEC));
     wanted_spec.callback = sdl_audio_callback;
     wanted_spec.userdata = opaque;
-    while (!(audio_dev = SDL_OpenAudioDevice(NULL, 0, &wanted_spec, &spec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE))) {
+    while (!(audio_dev = SDL_OpenAudioDevice(NULL, 0, &wanted_spec, &spec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE |
+                                             (audio_float ? SDL_AUDIO_ALLOW_FORMAT_CHANGE : 0)))) {
         av_log(NULL, AV_LOG_WARNING, "SDL_OpenAudio (%d channels, %d Hz): %s\n",
                wanted_spec.channels, wanted_spec.freq, SDL_GetError());
         wanted_spec.channels = next_nb_channels[FFMIN(7, wanted_spec.channels)];
@@ -880,10 +1190,19 @@ static int audio_open(void *opaque, AVChannelLayout *wanted_channel_layout, int
         }
         av_channel_layout_default(wanted_channel_layout, wanted_spec.channels);
     }
-    if (spec.format != AUDIO_S16SYS) {
-        av_log(NULL, AV_LOG_ERROR,
-               "SDL advised audio format %d is not supported!\n", spec.format);
-        return -1;
+    if (spec.format != AUDIO_S16SYS && spec.format != AUDIO_F32SYS) {
+        /* 设备原生格式既不是F32也不是S16：按S16重开，由SDL负责转换 */
+        SDL_AudioSpec s16_spec = wanted_spec;
+
+        av_log(NULL, AV_LOG_VERBOSE, "SDL advised audio format 0x%x, falling back to S16\n", spec.format);
+        SDL_CloseAudioDevice(audio_dev);
+        s16_spec.format = AUDIO_S16SYS;
+        s16_spec.freq = spec.freq;
+        s16_spec.channels = spec.channels;
+        if (!(audio_dev = SDL_OpenAudioDevice(NULL, 0, &s16_spec, &spec, 0))) {
+            av_log(NULL, AV_LOG_ERROR, "SDL_OpenAudio (S16): %s\n", SDL_GetError());
+            return -1;
+        }
     }
     if (spec.channels != wanted_spec.channels) {
         av_channel_layout_uninit(wanted_channel_layout);
@@ -895,7 +1214,7 @@ static int audio_open(void *opaque, AVChannelLayout *wanted_channel_layout, int
         }
     }
 
-    audio_hw_params->fmt = AV_SAMPLE_FMT_S16;
+    audio_hw_params->fmt = spec.format == AUDIO_F32SYS ? AV_SAMPLE_FMT_FLT : AV_SAMPLE_FMT_S16;
     audio_hw_params->freq = spec.freq;
     if (av_channel_layout_copy(&audio_hw_params->ch_layout, wanted_channel_layout) < 0)
         return -1;
@@ -1037,19 +1356,23 @@ fail:
 
 static int configure_audio_filters(VideoState *is, const char *afilters, int force_output_format)
 {
-    static const enum AVSampleFormat sample_fmts[] = { AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_NONE };
+    /* 设备格式未定时接受S16/F32的打包和平面格式，尽量让滤镜图不做格式转换 */
+    enum AVSampleFormat sample_fmts[] = { AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_S16P, AV_SAMPLE_FMT_NONE };
     int sample_rates[2] = { 0, -1 };
     AVFilterContext *filt_asrc = NULL, *filt_asink = NULL;
     char aresample_swr_opts[512] = "";
     const AVDictionaryEntry *e = NULL;
     AVBPrint bp;
     char asrc_args[256];
+    char *filters = NULL;
+    double rate = is->rate;
     int ret;
 
     avfilter_graph_free(&is->agraph);
+    is->audio.tempo_filter = NULL;
     if (!(is->agraph = avfilter_graph_alloc()))
         return AVERROR(ENOMEM);
-    is->agraph->nb_threads = filter_nbthreads;
+    worker_pool_attach_graph(is->agraph, POOL_STAGE_AFILTER);
 
     av_bprint_init(&bp, 0, AV_BPRINT_SIZE_AUTOMATIC);
 
@@ -1085,6 +1408,12 @@ static int configure_audio_filters(VideoState *is, const char *afilters, int for
         goto end;
 
     if (force_output_format) {
+        /* 只接受设备格式及其平面形式，平面数据在audio_thread中交织，不经过swr */
+        sample_fmts[0] = is->audio.audio_tgt.fmt;
+        sample_fmts[1] = av_get_planar_sample_fmt(is->audio.audio_tgt.fmt);
+        sample_fmts[2] = AV_SAMPLE_FMT_NONE;
+        if ((ret = av_opt_set_int_list(filt_asink, "sample_fmts", sample_fmts,  AV_SAMPLE_FMT_NONE, AV_OPT_SEARCH_CHILDREN)) < 0)
+            goto end;
         av_bprint_clear(&bp);
         av_channel_layout_describe_bprint(&is->audio.audio_tgt.ch_layout, &bp);
         sample_rates   [0] = is->audio.audio_tgt.freq;
@@ -1097,9 +1426,31 @@ static int configure_audio_filters(VideoState *is, const char *afilters, int for
     }
 
 
-    if ((ret = configure_filtergraph(is->agraph, afilters, filt_asrc, filt_asink)) < 0)
+    /* 变速播放：在用户滤镜之后做时间伸缩，atempo单级只支持0.5倍以上，更慢时串联两级 */
+    if (rate != 1.0) {
+        char tempo[64];
+        if (rate < 0.5)
+            snprintf(tempo, sizeof(tempo), "atempo=0.5,atempo=%f", rate / 0.5);
+        else
+            snprintf(tempo, sizeof(tempo), "atempo=%f", rate);
+        filters = afilters ? av_asprintf("%s,%s", afilters, tempo) : av_strdup(tempo);
+        if (!filters) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+    }
+
+    if ((ret = configure_filtergraph(is->agraph, filters ? filters : afilters, filt_asrc, filt_asink)) < 0)
         goto end;
 
+    /* atempo追加在用户滤镜之后，图中最后一个atempo就是插入的那一级 */
+    for (unsigned i = 0; rate != 1.0 && i < is->agraph->nb_filters; i++) {
+        if (!strcmp(is->agraph->filters[i]->filter->name, "atempo"))
+            is->audio.tempo_filter = is->agraph->filters[i];
+    }
+    is->audio.filter_rate = rate;
+    is->audio.tempo_pts = NAN;
+    is->audio.tempo_samples = 0;
     is->in_audio_filter  = filt_asrc;
     is->out_audio_filter = filt_asink;
 
@@ -1107,6 +1458,7 @@ end:
     if (ret < 0)
         avfilter_graph_free(&is->agraph);
     av_bprint_finalize(&bp, NULL);
+    av_free(filters);
 
     return ret;
 }
@@ -1142,6 +1494,118 @@ static int create_hwaccel(AVBufferRef **device_ctx)
     return ret;
 }
 
+/*------------------------------- 精确seek --------------------------------*/
+
+/* 读线程在seek前调用：目标生效于之后的序列号，seek后由accurate_seek_commit改为实际序列号 */
+static void accurate_seek_arm(VideoState *is, int64_t target)
+{
+    AccurateSeek *as = &is->aseek;
+    AVStream *vst = is->video.video_st;
+
+    as->video_serial = INT_MAX;
+    as->audio_serial = INT_MAX;
+    if (!accurate_seek || (is->seek_flags & AVSEEK_FLAG_BYTE))
+        return;
+    as->target = target;
+    if (vst && !(vst->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+        AVRational fr = av_guess_frame_rate(is->ic, vst, NULL);
+        as->frame_dur = fr.num && fr.den ? av_q2d((AVRational){fr.den, fr.num}) : 0;
+        as->video_serial = is->video.videoq.serial + 1;
+    }
+    if (is->audio.audio_st)
+        as->audio_serial = is->audio.audioq.serial + 1;
+}
+
+/* seek完成后调用：序列号没有变化的流（seek失败或未触及）不做跳帧 */
+static void accurate_seek_commit(VideoState *is, int ok, int old_video_serial, int old_audio_serial)
+{
+    AccurateSeek *as = &is->aseek;
+
+    if (as->video_serial != INT_MAX)
+        as->video_serial = ok && is->video.videoq.serial != old_video_serial ? is->video.videoq.serial : INT_MAX;
+    if (as->audio_serial != INT_MAX)
+        as->audio_serial = ok && is->audio.audioq.serial != old_audio_serial ? is->audio.audioq.serial : INT_MAX;
+}
+
+/* 视频帧是否仍在目标之前（取离目标最近的一帧作为目标帧） */
+static int accurate_seek_before_target(VideoState *is, int serial, double pts)
+{
+    AccurateSeek *as = &is->aseek;
+
+    if (serial < as->video_serial || serial == as->video_done || isnan(pts))
+        return 0;
+    return pts + as->frame_dur / 2 < as->target / (double)AV_TIME_BASE;
+}
+
+/* 到达目标帧：记录从stream_seek到目标帧解码完成的耗时 */
+static void accurate_seek_done(VideoState *is, const char *what, int skipped)
+{
+    AccurateSeek *as = &is->aseek;
+    int64_t elapsed = av_gettime_relative() - as->request_time;
+
+    as->count++;
+    as->total_time += elapsed;
+    if (elapsed > as->max_time)
+        as->max_time = elapsed;
+    av_log(NULL, AV_LOG_INFO, "Accurate seek to %0.3f: exact %s after %0.1fms (%d skipped)\n",
+           as->target / (double)AV_TIME_BASE, what, elapsed / 1000.0, skipped);
+}
+
+/* 视频解码线程：目标之前的帧直接丢弃，返回1表示已丢弃，2表示这是目标帧 */
+static int accurate_seek_video(VideoState *is, AVFrame *frame, double pts)
+{
+    AccurateSeek *as = &is->aseek;
+    int serial = is->video.viddec.pkt_serial;
+
+    if (serial < as->video_serial || serial == as->video_done)
+        return 0;
+    if (accurate_seek_before_target(is, serial, pts)) {
+        as->video_skipped++;
+        as->video_skipped_cur++;
+        av_frame_unref(frame);
+        return 1;
+    }
+    as->video_done = serial;
+    accurate_seek_done(is, "frame", as->video_skipped_cur);
+    as->video_skipped_cur = 0;
+    return 2;
+}
+
+/**
+ * 音频解码线程：按采样点裁掉目标之前的部分（frame->pts为1/sample_rate时基）
+ * @return 剩余采样数（0表示整帧丢弃），<0为错误
+ */
+static int accurate_seek_audio(VideoState *is, AVFrame *frame)
+{
+    AccurateSeek *as = &is->aseek;
+    int serial = is->audio.auddec.pkt_serial;
+    int64_t skip;
+    int ret;
+
+    if (serial < as->audio_serial || serial == as->audio_done)
+        return frame->nb_samples;
+    if (frame->pts != AV_NOPTS_VALUE) {
+        skip = av_rescale_q(as->target, AV_TIME_BASE_Q, (AVRational){1, frame->sample_rate}) - frame->pts;
+        if (skip >= frame->nb_samples) {
+            as->audio_trimmed += frame->nb_samples;
+            return 0;
+        }
+        if (skip > 0) {
+            if ((ret = av_frame_make_writable(frame)) < 0)
+                return ret;
+            av_samples_copy(frame->extended_data, frame->extended_data, 0, skip, frame->nb_samples - skip,
+                            frame->ch_layout.nb_channels, static_cast<AVSampleFormat>(frame->format));
+            frame->nb_samples -= skip;
+            frame->pts += skip;
+            as->audio_trimmed += skip;
+        }
+    }
+    as->audio_done = serial;
+    if (as->video_serial == INT_MAX)    // 没有视频时以音频到达目标计时
+        accurate_seek_done(is, "sample", 0);
+    return frame->nb_samples;
+}
+
 static inline
 int cmp_audio_fmts(enum AVSampleFormat fmt1, int64_t channel_count1,
                    enum AVSampleFormat fmt2, int64_t channel_count2)
@@ -1153,11 +1617,86 @@ int cmp_audio_fmts(enum AVSampleFormat fmt1, int64_t channel_count1,
         return channel_count1 != channel_count2 || fmt1 != fmt2;
 }
 
+/*
+* 取出音频滤镜图当前能输出的全部帧，送入sampq并写入PCM环
+* @return 滤镜图取帧的返回值（EAGAIN/EOF表示已取空），其他<0为中止或出错
+*/
+static int audio_filter_receive(VideoState *is, AVFrame *frame)
+{
+    Frame *af;
+    AVRational tb;
+    int ret;
+
+    while ((ret = av_buffersink_get_frame_flags(is->out_audio_filter, frame, 0)) >= 0) {
+        FrameData *fd = frame->opaque_ref ? (FrameData*)frame->opaque_ref->data : NULL;
+        tb = av_buffersink_get_time_base(is->out_audio_filter);
+        if (!(af = frame_queue_peek_writable(&is->audio.sampq)))
+            return -1;
+
+        af->pts = (frame->pts == AV_NOPTS_VALUE) ? NAN : frame->pts * av_q2d(tb);
+        if (is->audio.filter_rate != 1.0) {
+            /* atempo输出的时间戳按输出样本推进，换回媒体时间：首帧时间 + 已输出时长 * 倍速 */
+            if (isnan(is->audio.tempo_pts))
+                is->audio.tempo_pts = af->pts;
+            af->pts = is->audio.tempo_pts + (double)is->audio.tempo_samples * is->audio.filter_rate / frame->sample_rate;
+            is->audio.tempo_samples += frame->nb_samples;
+        }
+        af->pos = fd ? fd->pkt_pos : -1;
+        af->serial = is->audio.auddec.pkt_serial;
+        af->duration = av_q2d((AVRational){frame->nb_samples, frame->sample_rate});
+
+        av_frame_move_ref(af->frame, frame);
+        frame_queue_push(&is->audio.sampq);
+        if ((ret = audio_pump(is)) < 0)
+            return ret;
+
+        if (is->audio.audioq.serial != is->audio.auddec.pkt_serial)
+            break;
+    }
+    return ret;
+}
+
+/*
+* 倍速变化时直接修改atempo的tempo参数，滤镜内部缓存的样本按新倍速继续输出
+* 只在新旧倍速都只用一级atempo（0.5倍以上且不是1倍）时可行，否则返回<0由调用方重建滤镜图
+*/
+static int audio_filter_set_rate(VideoState *is, double rate)
+{
+    char arg[32];
+    int ret;
+
+    if (!is->audio.tempo_filter || rate == 1.0 || rate < 0.5 || is->audio.filter_rate < 0.5)
+        return AVERROR(ENOSYS);
+    snprintf(arg, sizeof(arg), "%f", rate);
+    if ((ret = avfilter_process_command(is->audio.tempo_filter, "tempo", arg, NULL, 0, 0)) < 0)
+        return ret;
+    /* 时间戳换算的起点移到切换处，之后按新倍速推进 */
+    if (!isnan(is->audio.tempo_pts))
+        is->audio.tempo_pts += (double)is->audio.tempo_samples * is->audio.filter_rate /
+                               av_buffersink_get_sample_rate(is->out_audio_filter);
+    is->audio.tempo_samples = 0;
+    is->audio.filter_rate = rate;
+    return 0;
+}
+
+/* 重建滤镜图前送入EOF，把atempo等滤镜缓存的样本全部取出，避免倍速切换时丢音 */
+static int audio_filter_drain(VideoState *is)
+{
+    AVFrame *frame = av_frame_alloc();
+    int ret;
+
+    if (!frame)
+        return AVERROR(ENOMEM);
+    if ((ret = av_buffersrc_add_frame(is->in_audio_filter, NULL)) >= 0)
+        ret = audio_filter_receive(is, frame);
+    av_frame_free(&frame);
+    return ret == AVERROR_EOF || ret == AVERROR(EAGAIN) ? 0 : ret;
+}
+
 static int audio_thread(void *arg)
 {
     VideoState *is = reinterpret_cast<VideoState*>(arg);
     AVFrame *frame = av_frame_alloc();
-    Frame *af;
     int last_serial = -1;
     int reconfigure;
     int got_frame = 0;
@@ -1171,6 +1710,13 @@ static int audio_thread(void *arg)
         if ((got_frame = decoder_decode_frame(&is->audio.auddec, frame, NULL)) < 0)
             goto the_end;
 
+        if (got_frame && (ret = accurate_seek_audio(is, frame)) <= 0) {
+            av_frame_unref(frame);
+            if (ret < 0)
+                goto the_end;
+            continue;
+        }
+
         if (got_frame) {
                 tb = (AVRational){1, frame->sample_rate};
 
@@ -1181,6 +1727,13 @@ static int audio_thread(void *arg)
                     is->audio.audio_filter_src.freq           != frame->sample_rate ||
                     is->audio.auddec.pkt_serial               != last_serial;
 
+                /* 只有倍速变化：能改参数就不重建；需要增删atempo时先排空旧图，保留缓存的样本 */
+                if (!reconfigure && is->audio.filter_rate != is->rate && audio_filter_set_rate(is, is->rate) < 0) {
+                    if ((ret = audio_filter_drain(is)) < 0)
+                        goto the_end;
+                    reconfigure = 1;
+                }
+
                 if (reconfigure) {
                     char buf1[1024], buf2[1024];
                     av_channel_layout_describe(&is->audio.audio_filter_src.ch_layout, buf1, sizeof(buf1));
@@ -1204,23 +1757,8 @@ static int audio_thread(void *arg)
             if ((ret = av_buffersrc_add_frame(is->in_audio_filter, frame)) < 0)
                 goto the_end;
 
-            while ((ret = av_buffersink_get_frame_flags(is->out_audio_filter, frame, 0)) >= 0) {
-                FrameData *fd = frame->opaque_ref ? (FrameData*)frame->opaque_ref->data : NULL;
-                tb = av_buffersink_get_time_base(is->out_audio_filter);
-                if (!(af = frame_queue_peek_writable(&is->audio.sampq)))
-                    goto the_end;
-
-                af->pts = (frame->pts == AV_NOPTS_VALUE) ? NAN : frame->pts * av_q2d(tb);
-                af->pos = fd ? fd->pkt_pos : -1;
-                af->serial = is->audio.auddec.pkt_serial;
-                af->duration = av_q2d((AVRational){frame->nb_samples, frame->sample_rate});
-
-                av_frame_move_ref(af->frame, frame);
-                frame_queue_push(&is->audio.sampq);
-
-                if (is->audio.audioq.serial != is->audio.auddec.pkt_serial)
-                    break;
-            }
+            if ((ret = audio_filter_receive(is, frame)) < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+                goto the_end;
             if (ret == AVERROR_EOF)
                 is->audio.auddec.finished = is->audio.auddec.pkt_serial;
         }
@@ -1242,6 +1780,10 @@ static int queue_picture(VideoState *is, AVFrame *src_frame, double pts, double
 
     if (!(vp = frame_queue_peek_writable(&is->video.pictq)))
         return -1;
+    if (latency_trace) {
+        FrameData *fd = frame_data_stamp(&src_frame->opaque_ref, LAT_QUEUED);
+        vp->lat = fd ? *fd : FrameData();   // 之后的阶段在主线程写这份副本
+    }
 
     vp->sar = src_frame->sample_aspect_ratio;
     vp->uploaded = 0;
@@ -1414,24 +1956,43 @@ fail:
     return ret;
 }
 
+/* video_thread：当前解码的帧是否属于倒放 */
+static int reverse_frame(VideoState *is)
+{
+    return is->rev.active && is->video.viddec.pkt_serial == is->rev.serial;
+}
+
 static int get_video_frame(VideoState *is, AVFrame *frame)
 {
     int got_picture;
 
-    if ((got_picture = decoder_decode_frame(&is->video.viddec, frame, NULL)) < 0)
+    if (is->video.gop) {
+        got_picture = gop_decoder_get_frame(is->video.gop, frame, &is->video.viddec.pkt_serial);
+        if (!got_picture)
+            is->video.viddec.finished = is->video.viddec.pkt_serial;
+    } else {
+        got_picture = decoder_decode_frame(&is->video.viddec, frame, NULL);
+    }
+    if (got_picture < 0)
         return -1;
 
     if (got_picture) {
         double dpts = NAN;
+        int seek_state;
 
         if (frame->pts != AV_NOPTS_VALUE)
             dpts = av_q2d(is->video.video_st->time_base) * frame->pts;
 
         frame->sample_aspect_ratio = av_guess_sample_aspect_ratio(is->ic, is->video.video_st, frame);
 
-        if (framedrop > 0 || (framedrop && get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER)) {
+        seek_state = accurate_seek_video(is, frame, dpts);
+        if (seek_state == 1)
+            return 0;
+
+        // 精确seek的目标帧总是保留
+        if (seek_state != 2 && !reverse_frame(is) && (framedrop > 0 || (framedrop && get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER))) {
             if (frame->pts != AV_NOPTS_VALUE) {
-                double diff = dpts - get_master_clock(is);
+                double diff = (dpts - get_master_clock(is)) / is->rate;   // 换算为墙钟时间，与compute_target_delay一致
                 if (!isnan(diff) && fabs(diff) < AV_NOSYNC_THRESHOLD &&
                     diff - is->video.frame_last_filter_delay < 0 &&
                     is->video.viddec.pkt_serial == is->vidclk.serial &&
@@ -1447,6 +2008,200 @@ static int get_video_frame(VideoState *is, AVFrame *frame)
     return got_picture;
 }
 
+/* video_thread：释放全部缓存帧 */
+static void reverse_cache_reset(ReversePlay *rp, int serial)
+{
+    for (int i = 0; i < REVERSE_GOP_RING; i++) {
+        ReverseGop *g = &rp->gops[i];
+        for (int j = g->emitted; j < g->nb; j++)
+            av_frame_free(&g->frames[j].frame);
+        g->nb = g->emitted = 0;
+    }
+    rp->head = rp->tail = 0;
+    rp->cache_bytes = 0;
+    rp->stride = 1;
+    rp->seq = 0;
+    rp->gop_start = 0;
+    rp->cache_serial = serial;
+}
+
+/**
+ * video_thread：把完整GOP的帧送入pictq
+ * @param block 为0时pictq满即返回；为1时阻塞送出一帧后返回
+ */
+static int reverse_emit(VideoState *is, int block)
+{
+    ReversePlay *rp = &is->rev;
+
+    while (rp->head < rp->tail) {
+        ReverseGop *g = &rp->gops[rp->head % REVERSE_GOP_RING];
+        ReverseEntry *e;
+        int ret;
+
+        if (g->emitted == g->nb) {
+            g->nb = g->emitted = 0;
+            rp->head++;
+            rp->emitted++;
+            continue;
+        }
+        if (!block && is->video.pictq.size.load() >= is->video.pictq.max_size)
+            return 0;
+        e = &g->frames[g->emitted++];
+        rp->cache_bytes -= e->bytes;
+        ret = queue_picture(is, e->frame, e->pts, e->duration, e->pos, rp->cache_serial);
+        av_frame_free(&e->frame);
+        if (ret < 0 || block)
+            return ret;
+    }
+    return 0;
+}
+
+static int reverse_cmp_pts(const void *a, const void *b)
+{
+    double pa = ((const ReverseEntry*)a)->pts, pb = ((const ReverseEntry*)b)->pts;
+    return (pa < pb) - (pa > pb);
+}
+
+/* video_thread：当前GOP排空，按pts降序排好等待送出 */
+static void reverse_gop_done(VideoState *is)
+{
+    ReversePlay *rp = &is->rev;
+    ReverseGop *g = &rp->gops[rp->tail % REVERSE_GOP_RING];
+
+    qsort(g->frames, g->nb, sizeof(*g->frames), reverse_cmp_pts);
+    if (rp->gop_start) {
+        int64_t elapsed = av_gettime_relative() - rp->gop_start;
+        rp->decode_time += elapsed;
+        rp->decode_max = FFMAX(rp->decode_max, elapsed);
+        av_log(NULL, AV_LOG_DEBUG, "reverse GOP %0.3f-%0.3f: %d frames decoded in %0.1fms\n",
+               rp->bounds[rp->tail % REVERSE_GOP_RING][0], rp->bounds[rp->tail % REVERSE_GOP_RING][1],
+               g->nb, elapsed / 1000.0);
+    }
+    rp->gops_done++;
+    rp->frames += g->nb;
+    rp->tail++;
+    rp->stride = 1;
+    rp->seq = 0;
+    rp->gop_start = 0;
+}
+
+/* video_thread：缓存倒放GOP中的一帧（frame的引用被取走） */
+static int reverse_cache_add(VideoState *is, AVFrame *frame, double pts, double duration, int64_t pos)
+{
+    ReversePlay *rp = &is->rev;
+    ReverseGop *g;
+    ReverseEntry *e;
+    int64_t limit = (int64_t)reverse_mem << 20, bytes = 0;
+    const double *range;
+    int ret;
+
+    if (rp->cache_serial != rp->serial)
+        reverse_cache_reset(rp, rp->serial);
+    g = &rp->gops[rp->tail % REVERSE_GOP_RING];
+    range = rp->bounds[rp->tail % REVERSE_GOP_RING];
+    if (!rp->gop_start)
+        rp->gop_start = av_gettime_relative();
+
+    /* 前导帧由前一个GOP解出，下一GOP的关键帧只作参考 */
+    if (!isnan(pts) && (pts < range[0] || pts >= range[1])) {
+        av_frame_unref(frame);
+        return 0;
+    }
+    if (rp->seq++ % rp->stride) {
+        rp->thinned++;
+        av_frame_unref(frame);
+        return 0;
+    }
+
+    for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++)
+        bytes += frame->buf[i]->size;
+    /* 超出内存上限：先送出已完整的GOP，仍不够则当前GOP隔帧抽掉一半 */
+    while (rp->cache_bytes + bytes > limit && rp->head < rp->tail)
+        if ((ret = reverse_emit(is, 1)) < 0)
+            return ret;
+    if (rp->cache_bytes + bytes > limit && g->nb > 1) {
+        int kept = 0;
+        for (int i = 0; i < g->nb; i++) {
+            if (i & 1) {
+                rp->cache_bytes -= g->frames[i].bytes;
+                av_frame_free(&g->frames[i].frame);
+                rp->thinned++;
+            } else {
+                g->frames[kept++] = g->frames[i];
+            }
+        }
+        g->nb = kept;
+        rp->stride *= 2;
+    }
+
+    if (g->nb == g->allocated) {
+        int n = FFMAX(16, g->allocated * 2);
+        ReverseEntry *tmp = (ReverseEntry*)av_realloc_array(g->frames, n, sizeof(*tmp));
+        if (!tmp)
+            return AVERROR(ENOMEM);
+        g->frames = tmp;
+        g->allocated = n;
+    }
+    e = &g->frames[g->nb];
+    if (!(e->frame = av_frame_alloc()))
+        return AVERROR(ENOMEM);
+    av_frame_move_ref(e->frame, frame);
+    e->pts = pts;
+    e->duration = duration;
+    e->pos = pos;
+    e->bytes = bytes;
+    g->nb++;
+    rp->cache_bytes += bytes;
+    rp->peak_bytes = FFMAX(rp->peak_bytes, rp->cache_bytes);
+    return 0;
+}
+
+/* video_thread退出时释放缓存 */
+static void reverse_cache_free(ReversePlay *rp)
+{
+    reverse_cache_reset(rp, -1);
+    for (int i = 0; i < REVERSE_GOP_RING; i++)
+        av_freep(&rp->gops[i].frames);
+}
+
+/*
+* Decoder丢包回调，在解码前丢弃非参考帧数据包：
+* 精确seek跳向目标期间目标之前的包；或视频已落后于主时钟（条件同get_video_frame的提前丢帧）。
+* 倍速达到PLAYBACK_RATE_SKIP时即使关闭了解码前丢包/丢帧也做落后判断，但只丢真正落后的包
+*/
+static int video_drop_packet(void *opaque, const AVPacket *pkt)
+{
+    VideoState *is = reinterpret_cast<VideoState*>(opaque);
+    int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    int rate_skip = is->rate >= PLAYBACK_RATE_SKIP && !is->step;
+    double diff;
+
+    if (reverse_frame(is))
+        return 0;
+    if (pkt->pts != AV_NOPTS_VALUE &&
+        accurate_seek_before_target(is, is->video.viddec.pkt_serial, av_q2d(is->video.video_st->time_base) * pkt->pts)) {
+        if (!packet_is_disposable(is->video.viddec.avctx, pkt))
+            return 0;
+        is->aseek.video_dropped++;
+        is->aseek.video_skipped_cur++;
+        return 1;
+    }
+    if (!rate_skip && (!packet_drop || !(framedrop > 0 || (framedrop && get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER))))
+        return 0;
+    if (ts == AV_NOPTS_VALUE || is->video.viddec.pkt_serial != is->vidclk.serial || !is->video.videoq.nb_packets)
+        return 0;
+    diff = (av_q2d(is->video.video_st->time_base) * ts - get_master_clock(is)) / is->rate;   // 换算为墙钟时间
+    if (isnan(diff) || fabs(diff) >= AV_NOSYNC_THRESHOLD || diff - is->video.frame_last_filter_delay >= 0)
+        return 0;
+    if (!packet_is_disposable(is->video.viddec.avctx, pkt))
+        return 0;
+    if (rate_skip)
+        is->video.frame_skips_rate++;
+    else
+        is->video.frame_drops_pkt++;
+    return 1;
+}
+
 //解码
 static int video_thread(void *arg)
 {
@@ -1465,16 +2220,35 @@ static int video_thread(void *arg)
     enum AVPixelFormat last_format = static_cast<AVPixelFormat>(-2);
     int last_serial = -1;
     int last_vfilter_idx = 0;
+    int64_t work_start = av_gettime_relative();   // 本帧生产计时起点（不含等待帧队列空位）
+    int64_t wait_start = 0;                       // 计时起点处viddec.wait_us，扣除等待数据包的时间
+    double work;
 
     if (!frame)
         return AVERROR(ENOMEM);
 
     for (;;) {
+        /* 倒放：有完整的GOP时先送入pictq；没有待解码的包时阻塞送出，直到读线程送来下一个GOP */
+        if (is->rev.cache_serial >= 0 && is->rev.cache_serial != is->video.videoq.serial)
+            reverse_cache_reset(&is->rev, -1);
+        while (is->rev.head < is->rev.tail) {
+            int block = is->video.videoq.nb_packets == 0;
+            if ((ret = reverse_emit(is, block)) < 0)
+                goto the_end;
+            if (!block)
+                break;
+        }
+
         ret = get_video_frame(is, frame);
         if (ret < 0)
             goto the_end;
-        if (!ret)
+        if (!ret) {
+            if (reverse_frame(is) && is->video.viddec.finished == is->video.viddec.pkt_serial) {
+                is->video.viddec.finished = 0;
+                reverse_gop_done(is);
+            }
             continue;
+        }
 
         if (   last_w != frame->width
             || last_h != frame->height
@@ -1493,7 +2267,7 @@ static int video_thread(void *arg)
                 ret = AVERROR(ENOMEM);
                 goto the_end;
             }
-            graph->nb_threads = filter_nbthreads;
+            worker_pool_attach_graph(graph, POOL_STAGE_VFILTER);
             if ((ret = configure_video_filters(graph, is, vfilters_list ? vfilters_list[is->vfilter_idx] : NULL, frame)) < 0) {
                 SDL_Event event;
                 event.type = FF_QUIT_EVENT;
@@ -1528,6 +2302,8 @@ static int video_thread(void *arg)
                 break;
             }
 
+            if (latency_trace)
+                frame_data_stamp(&frame->opaque_ref, LAT_FILTERED);
             fd = frame->opaque_ref ? (FrameData*)frame->opaque_ref->data : NULL;
 
             is->video.frame_last_filter_delay = av_gettime_relative() / 1000000.0 - is->video.frame_last_returned_time;
@@ -1536,7 +2312,18 @@ static int video_thread(void *arg)
             tb = av_buffersink_get_time_base(filt_out);
             duration = (frame_rate.num && frame_rate.den ? av_q2d((AVRational){frame_rate.den, frame_rate.num}) : 0);
             pts = (frame->pts == AV_NOPTS_VALUE) ? NAN : frame->pts * av_q2d(tb);
-            ret = queue_picture(is, frame, pts, duration, fd ? fd->pkt_pos : -1, is->video.viddec.pkt_serial);
+            work = (av_gettime_relative() - work_start - (is->video.viddec.wait_us - wait_start)) / 1000000.0;
+            frame_queue_adapt(&is->video.pictq, work, duration);
+            if (auto_degrade && !is->video.gop)
+                degrade_controller_update(&is->video.degrade, &is->video.viddec, work, duration,
+                                          is->video.frame_drops_early + is->video.frame_drops_late +
+                                          is->video.frame_drops_pkt);
+            if (reverse_frame(is))
+                ret = reverse_cache_add(is, frame, pts, duration, fd ? fd->pkt_pos : -1);
+            else
+                ret = queue_picture(is, frame, pts, duration, fd ? fd->pkt_pos : -1, is->video.viddec.pkt_serial);
+            work_start = av_gettime_relative();
+            wait_start = is->video.viddec.wait_us;
             av_frame_unref(frame);
             if (is->video.videoq.serial != is->video.viddec.pkt_serial)
                 break;
@@ -1546,6 +2333,7 @@ static int video_thread(void *arg)
             goto the_end;
     }
  the_end:
+    reverse_cache_free(&is->rev);
     avfilter_graph_free(&graph);
     av_frame_free(&frame);
     return 0;
@@ -1585,6 +2373,47 @@ static int subtitle_thread(void *arg)
     return 0;
 }
 
+/*
+* 按实测码率刷新各路流的字节水位
+* 码率优先取已入队数据的实测值（样本不足2秒时退回容器/编码参数），
+* 未显式指定字节水位时按时长水位换算，并限制在[256KB, 1GB]之间
+*/
+static void update_stream_watermarks(VideoState *is, AVStream *st, PacketQueue *q)
+{
+    const BufferWatermarks *wm = &buffer_watermarks[st->codecpar->codec_type];
+    double rate = packet_queue_input_rate(q);   // 字节/秒
+    int64_t low, high;
+
+    if (rate <= 0 && st->codecpar->bit_rate > 0)
+        rate = st->codecpar->bit_rate / 8.0;
+    else if (rate <= 0 && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && is->ic->bit_rate > 0)
+        rate = is->ic->bit_rate / 8.0;
+
+    if (wm->high_bytes >= 0)
+        high = wm->high_bytes;
+    else if (rate > 0)
+        high = av_clip64((int64_t)(rate * FFMAX(wm->high_sec, 1.0) * 2), WATERMARK_MIN_BYTES, WATERMARK_MAX_BYTES);
+    else
+        high = MAX_QUEUE_SIZE;
+    if (wm->low_bytes >= 0)
+        low = wm->low_bytes;
+    else
+        low = rate > 0 ? FFMIN((int64_t)(rate * wm->low_sec), high / 2) : 0;
+    q->low_bytes.store(low, std::memory_order_relaxed);
+    q->high_bytes.store(high, std::memory_order_relaxed);
+}
+
+/* 打开流时设置时间基和时长水位（在解码线程启动前，之后不再改写） */
+static void init_stream_watermarks(VideoState *is, AVStream *st, PacketQueue *q)
+{
+    const BufferWatermarks *wm = &buffer_watermarks[st->codecpar->codec_type];
+
+    q->time_base = st->time_base;
+    q->low_sec = wm->low_sec;
+    q->high_sec = wm->high_sec;
+    update_stream_watermarks(is, st, q);
+}
+
 static int stream_component_open(VideoState *is, int stream_index)
 {
     AVFormatContext *ic = is->ic;
@@ -1598,6 +2427,7 @@ static int stream_component_open(VideoState *is, int stream_index)
     memset(&ch_layout, 0, sizeof(AVChannelLayout));
     int ret = 0;
     int stream_lowres = 0;
+    int pool_codec;         // 解码器的切片任务由共享池执行
 
     if (stream_index < 0 || stream_index >= ic->nb_streams)
         return -1;
@@ -1645,8 +2475,19 @@ static int stream_component_open(VideoState *is, int stream_index)
     if (ret < 0)
         goto fail;
 
-    if (!av_dict_get(opts, "threads", NULL, 0))
-        av_dict_set(&opts, "threads", "auto", 0);
+    /*
+    * 共享池只接管没有帧线程的解码器：帧线程解码器（H.264/HEVC等）不参与，按默认方式自带线程，
+    * 其余以切片模式、线程数=池参与者数打开，使解码器按此数分配每线程状态，execute2的threadnr不越界
+    */
+    pool_codec = worker_pool && !(codec->capabilities & AV_CODEC_CAP_FRAME_THREADS);
+    if (!av_dict_get(opts, "threads", NULL, 0)) {
+        if (pool_codec)
+            av_dict_set_int(&opts, "threads", worker_pool->nb_threads + 1, 0);
+        else
+            av_dict_set(&opts, "threads", "auto", 0);
+    }
+    if (pool_codec && !av_dict_get(opts, "thread_type", NULL, 0))
+        av_dict_set(&opts, "thread_type", "slice", 0);
     if (stream_lowres)
         av_dict_set_int(&opts, "lowres", stream_lowres, 0);
 
@@ -1656,12 +2497,31 @@ static int stream_component_open(VideoState *is, int stream_index)
         ret = create_hwaccel(&avctx->hw_device_ctx);
         if (ret < 0)
             goto fail;
+        /* GOP并行时主上下文不解码（只提供参数和帧缓冲池），不必开帧线程 */
+        if (gop_parallel && gop_decoder_supported(avctx))
+            av_dict_set(&opts, "threads", "1", 0);
+        if (video_frame_pool && (codec->capabilities & AV_CODEC_CAP_DR1)) {
+            if (!is->video.frame_pool && !(is->video.frame_pool = frame_pool_alloc())) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+            avctx->opaque = is->video.frame_pool;
+            avctx->get_buffer2 = frame_pool_get_buffer2;
+        }
     }
 
     
     if ((ret = avcodec_open2(avctx, codec, &opts)) < 0) {
         goto fail;
     }
+    if (pool_codec && avctx->active_thread_type == FF_THREAD_SLICE) {
+        /* 覆盖avcodec_open2安装的切片线程实现，切片任务改由共享池执行（libavcodec自己的切片线程此后一直空闲阻塞） */
+        avctx->execute = worker_pool_execute;
+        avctx->execute2 = worker_pool_execute2;
+    } else if (worker_pool) {
+        av_log(NULL, AV_LOG_VERBOSE, "-shared_pool: %s decoder stays off the shared pool (%s)\n", codec->name,
+               avctx->active_thread_type & FF_THREAD_FRAME ? "own frame threads" : "no slice threading");
+    }
     if ((t = av_dict_get(opts, "", NULL, AV_DICT_IGNORE_SUFFIX))) {
         av_log(NULL, AV_LOG_ERROR, "Option %s not found.\n", t->key);
         ret =  AVERROR_OPTION_NOT_FOUND;
@@ -1694,8 +2554,10 @@ static int stream_component_open(VideoState *is, int stream_index)
             goto fail;
         is->audio.audio_hw_buf_size = ret;
         is->audio.audio_src = is->audio.audio_tgt;
-        is->audio.audio_buf_size  = 0;
-        is->audio.audio_buf_index = 0;
+        is->audio.audio_gain = 0.0f;   // 开播从静音渐入
+        if ((ret = pcm_ring_init(&is->audio.pcm, FFMAX(4 * is->audio.audio_hw_buf_size,
+                                 (int)(is->audio.audio_tgt.bytes_per_sec * PCM_RING_SECONDS)))) < 0)
+            goto fail;
 
         /* init averaging filter */
         is->audio.audio_diff_avg_coef  = exp(log(0.01) / AUDIO_DIFF_AVG_NB);
@@ -1706,6 +2568,7 @@ static int stream_component_open(VideoState *is, int stream_index)
 
         is->audio_stream = stream_index;
         is->audio.audio_st = ic->streams[stream_index];
+        init_stream_watermarks(is, is->audio.audio_st, &is->audio.audioq);
 
         if ((ret = decoder_init(&is->audio.auddec, avctx, &is->audio.audioq, is->continue_read_thread)) < 0)
             goto fail;
@@ -1720,9 +2583,28 @@ static int stream_component_open(VideoState *is, int stream_index)
     case AVMEDIA_TYPE_VIDEO:
         is->video_stream = stream_index;
         is->video.video_st = ic->streams[stream_index];
+        init_stream_watermarks(is, is->video.video_st, &is->video.videoq);
+        degrade_controller_init(&is->video.degrade, avctx);
 
         if ((ret = decoder_init(&is->video.viddec, avctx, &is->video.videoq, is->continue_read_thread)) < 0)
             goto fail;
+        is->video.viddec.drop_packet = video_drop_packet;   // 各项丢包条件在钩子内判断（倍速可随时调整）
+        is->video.viddec.drop_opaque = is;
+        if (gop_parallel) {
+            ret = gop_decoder_create(&is->video.gop, avctx, ic->streams[stream_index]->codecpar,
+                                     &is->video.videoq, is->continue_read_thread, gop_parallel);
+            if (ret == AVERROR(ENOSYS))
+                av_log(NULL, AV_LOG_WARNING, "-gop_parallel: %s is not intra-only (add -gop_closed if every keyframe starts a closed GOP)\n",
+                       avcodec_get_name(avctx->codec_id));
+            else if (ret < 0)
+                av_log(NULL, AV_LOG_WARNING, "-gop_parallel: cannot create the parallel decoders, using a single decoder\n");
+            else if ((ret = gop_decoder_start(is->video.gop)) < 0)
+                goto out;
+            else
+                av_log(NULL, AV_LOG_INFO, "Decoding %s with %d parallel decoders (%s units)\n", avcodec_get_name(avctx->codec_id),
+                       is->video.gop->nb_workers, is->video.gop->key_units ? "GOP" : "frame");
+            ret = 0;
+        }
         if ((ret = decoder_start(&is->video.viddec, video_thread, "video_decoder", is)) < 0)
             goto out;
         is->queue_attachments_req = 1;
@@ -1730,6 +2612,7 @@ static int stream_component_open(VideoState *is, int stream_index)
     case AVMEDIA_TYPE_SUBTITLE:
         is->subtitle_stream = stream_index;
         is->subtitle.subtitle_st = ic->streams[stream_index];
+        init_stream_watermarks(is, is->subtitle.subtitle_st, &is->subtitle.subtitleq);
 
         if ((ret = decoder_init(&is->subtitle.subdec, avctx, &is->subtitle.subtitleq, is->continue_read_thread)) < 0)
             goto fail;
@@ -1764,16 +2647,426 @@ static void stream_seek(VideoState *is, int64_t pos, int64_t rel, int by_bytes)
         is->seek_flags &= ~AVSEEK_FLAG_BYTE;
         if (by_bytes)
             is->seek_flags |= AVSEEK_FLAG_BYTE;
+        is->aseek.request_time = av_gettime_relative();
         is->seek_req = 1;
+        SDL_LockMutex(is->continue_read_mutex);
         SDL_CondSignal(is->continue_read_thread);
+        SDL_UnlockMutex(is->continue_read_mutex);
+    }
+}
+
+/*------------------------------- 关键帧快进/快退 --------------------------------*/
+
+/* 按键切换倍速：dir=1向快进方向，-1向快退方向 */
+static void trick_play_change(VideoState *is, int dir)
+{
+    AVStream *vst = is->video.video_st;
+    int i, n = FF_ARRAY_ELEMS(trick_speeds);
+
+    if (!vst || (vst->disposition & AV_DISPOSITION_ATTACHED_PIC) || is->realtime) {
+        av_log(NULL, AV_LOG_WARNING, "Trick play needs a seekable video stream\n");
+        return;
+    }
+    for (i = 0; i < n && trick_speeds[i] != is->trick.speed; i++)
+        ;
+    is->trick.speed = trick_speeds[av_clip(i + dir, 0, n - 1)];
+    is->rev.requested = 0;
+    SDL_LockMutex(is->continue_read_mutex);
+    SDL_CondSignal(is->continue_read_thread);
+    SDL_UnlockMutex(is->continue_read_mutex);
+}
+
+/* 快进快退/倒放期间只读视频：音频、字幕流discard=all并清空队列；on=0时恢复 */
+static void trick_set_discard(VideoState *is, int on, enum AVDiscard video)
+{
+    is->video.video_st->discard = on ? video : AVDISCARD_DEFAULT;
+    if (is->audio.audio_st) {
+        is->audio.audio_st->discard = on ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+        if (on)
+            packet_queue_flush(&is->audio.audioq);
+    }
+    if (is->subtitle.subtitle_st) {
+        is->subtitle.subtitle_st->discard = on ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+        if (on)
+            packet_queue_flush(&is->subtitle.subtitleq);
+    }
+}
+
+/* 读线程：进入关键帧播放 */
+static void trick_play_start(VideoState *is)
+{
+    TrickPlay *tp = &is->trick;
+    AVStream *vst = is->video.video_st;
+    double pos = get_master_clock(is);
+
+    if (isnan(pos))
+        pos = is->seek_pos / (double)AV_TIME_BASE;
+    tp->pos = (int64_t)(pos * AV_TIME_BASE);
+    tp->last_ts = av_rescale_q(tp->pos, AV_TIME_BASE_Q, vst->time_base);
+    tp->next_time = 0;
+    tp->queued_serial = -1;
+    tp->active = 1;
+    trick_set_discard(is, 1, AVDISCARD_NONKEY);
+    av_log(NULL, AV_LOG_INFO, "Trick play %+dx from %0.3f\n", tp->speed.load(), pos);
+}
+
+/* 读线程：退出关键帧播放，没有其他seek请求时回到最后显示的关键帧继续正常播放 */
+static void trick_play_stop(VideoState *is)
+{
+    TrickPlay *tp = &is->trick;
+
+    trick_set_discard(is, 0, AVDISCARD_DEFAULT);
+    tp->active = 0;
+    tp->speed = 0;
+    if (!is->seek_req)
+        stream_seek(is, tp->pos, 0, 0);
+    av_log(NULL, AV_LOG_INFO, "Trick play off at %0.3f\n", tp->pos / (double)AV_TIME_BASE);
+}
+
+/**
+ * 读线程：送出下一个关键帧
+ * 快进用min_ts=上一关键帧+1、快退用max_ts=上一关键帧-1做索引seek，保证每步都换到新的关键帧；
+ * 到达文件首尾时把倍速置0，由读线程退出关键帧播放
+ */
+static int trick_play_step(VideoState *is, AVPacket *pkt)
+{
+    TrickPlay *tp = &is->trick;
+    AVFormatContext *ic = is->ic;
+    AVStream *vst = is->video.video_st;
+    int speed = tp->speed;
+    int64_t start = av_gettime_relative(), target, ts;
+    double delta;
+    int ret, n;
+
+    /* 暂停、未到下一步时间或上一个关键帧还没显示时等待：下一步的flush会丢掉尚未显示的帧 */
+    if (!speed || is->paused || start < tp->next_time ||
+        (tp->queued_serial >= 0 && tp->shown_serial != tp->queued_serial &&
+         start - tp->queued_time < TRICK_SHOW_TIMEOUT)) {
+        SDL_LockMutex(is->continue_read_mutex);
+        SDL_CondWaitTimeout(is->continue_read_thread, is->continue_read_mutex, 10);
+        SDL_UnlockMutex(is->continue_read_mutex);
+        return 0;
+    }
+
+    target = tp->last_ts + av_rescale_q((int64_t)(speed * TRICK_STEP * AV_TIME_BASE), AV_TIME_BASE_Q, vst->time_base);
+    if (speed < 0 && vst->start_time != AV_NOPTS_VALUE && tp->last_ts <= vst->start_time)
+        ret = AVERROR(ERANGE);
+    else if (speed > 0)
+        ret = avformat_seek_file(ic, is->video_stream, tp->last_ts + 1, target, INT64_MAX, 0);
+    else
+        ret = avformat_seek_file(ic, is->video_stream, INT64_MIN, target, tp->last_ts - 1, 0);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_INFO, "Trick play reached the %s\n", speed > 0 ? "end" : "start");
+        tp->speed = 0;
+        return 0;
+    }
+
+    for (n = 0; ; n++) {
+        if ((ret = av_read_frame(ic, pkt)) < 0 || n >= TRICK_MAX_PACKETS) {
+            if (ret >= 0)
+                av_packet_unref(pkt);
+            tp->speed = 0;
+            return ret == AVERROR_EOF || ret >= 0 ? 0 : ret;
+        }
+        tp->packets++;
+        if (pkt->stream_index == is->video_stream && (pkt->flags & AV_PKT_FLAG_KEY))
+            break;
+        av_packet_unref(pkt);
+    }
+
+    ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    if (ts == AV_NOPTS_VALUE || (speed > 0 ? ts <= tp->last_ts : ts >= tp->last_ts)) {
+        /* 没有索引时seek只是近似定位，未能前进则下一步从目标位置继续 */
+        av_packet_unref(pkt);
+        tp->last_ts = target;
+        return 0;
+    }
+
+    packet_queue_flush(&is->video.videoq);
+    packet_queue_put(&is->video.videoq, pkt);
+    packet_queue_put_nullpacket(&is->video.videoq, pkt, is->video_stream);  // 让解码器立即输出这一帧
+    tp->queued_serial = is->video.videoq.serial;
+    tp->queued_time = av_gettime_relative();
+
+    delta = fabs((ts - tp->last_ts) * av_q2d(vst->time_base));
+    tp->last_ts = ts;
+    tp->pos = av_rescale_q(ts, vst->time_base, AV_TIME_BASE_Q);
+    tp->next_time = start + (int64_t)(av_clipd(delta / abs(speed), TRICK_STEP_MIN, TRICK_STEP_MAX) * 1000000);
+    tp->steps++;
+    tp->step_time += av_gettime_relative() - start;
+    return 0;
+}
+
+/*------------------------------- 倒放 --------------------------------*/
+
+/* 按键切换倒放 */
+static void reverse_toggle(VideoState *is)
+{
+    AVStream *vst = is->video.video_st;
+
+    if (!vst || (vst->disposition & AV_DISPOSITION_ATTACHED_PIC) || is->realtime || is->video.gop) {
+        av_log(NULL, AV_LOG_WARNING, "Reverse playback needs a seekable video stream and a single decoder\n");
+        return;
+    }
+    is->trick.speed = 0;
+    is->rev.requested = !is->rev.requested;
+    SDL_LockMutex(is->continue_read_mutex);
+    SDL_CondSignal(is->continue_read_thread);
+    SDL_UnlockMutex(is->continue_read_mutex);
+}
+
+/* 读线程：进入倒放，从当前位置所在的GOP开始 */
+static void reverse_start(VideoState *is)
+{
+    ReversePlay *rp = &is->rev;
+    AVStream *vst = is->video.video_st;
+    double pos = get_master_clock(is);
+
+    if (isnan(pos))
+        pos = is->seek_pos / (double)AV_TIME_BASE;
+    rp->pos = (int64_t)(pos * AV_TIME_BASE);
+    rp->gop_end = av_rescale_q(rp->pos, AV_TIME_BASE_Q, vst->time_base);
+    trick_set_discard(is, 1, AVDISCARD_DEFAULT);
+    packet_queue_flush(&is->video.videoq);
+    rp->sent = 0;
+    rp->emitted = 0;
+    rp->serial = is->video.videoq.serial;
+    rp->active = 1;
+    av_log(NULL, AV_LOG_INFO, "Reverse playback from %0.3f\n", pos);
+}
+
+/* 读线程：退出倒放，没有其他seek请求时从最后送出的GOP起点继续正向播放 */
+static void reverse_stop(VideoState *is)
+{
+    ReversePlay *rp = &is->rev;
+
+    trick_set_discard(is, 0, AVDISCARD_DEFAULT);
+    rp->active = 0;
+    rp->requested = 0;
+    rp->serial = -1;
+    if (!is->seek_req)
+        stream_seek(is, rp->pos, 0, 0);
+    av_log(NULL, AV_LOG_INFO, "Reverse playback off at %0.3f\n", rp->pos / (double)AV_TIME_BASE);
+}
+
+/* 读线程：seek到gop_end之前的关键帧并读出该关键帧包，返回其时间戳（AV_NOPTS_VALUE表示已到文件开头） */
+static int64_t reverse_seek_keyframe(VideoState *is, AVPacket *pkt)
+{
+    AVFormatContext *ic = is->ic;
+    AVStream *vst = is->video.video_st;
+    int64_t hi = is->rev.gop_end, target, ts;
+
+    for (int retry = 0; retry < REVERSE_SEEK_RETRY; retry++) {
+        target = hi - 1 - av_rescale_q(retry * (int64_t)AV_TIME_BASE, AV_TIME_BASE_Q, vst->time_base);
+        if (vst->start_time != AV_NOPTS_VALUE && hi <= vst->start_time)
+            break;
+        if (avformat_seek_file(ic, is->video_stream, INT64_MIN, target, target, 0) < 0)
+            break;
+        for (int n = 0; n < REVERSE_MAX_PACKETS; n++) {
+            if (av_read_frame(ic, pkt) < 0)
+                break;
+            if (pkt->stream_index == is->video_stream && (pkt->flags & AV_PKT_FLAG_KEY)) {
+                ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+                if (ts != AV_NOPTS_VALUE && ts < hi)
+                    return ts;
+                break;  // 无索引时的近似seek没有后退，多退一些重试
+            }
+            av_packet_unref(pkt);
+        }
+        av_packet_unref(pkt);
+    }
+    return AV_NOPTS_VALUE;
+}
+
+/**
+ * 读线程：送出前一个GOP
+ * 从关键帧读到下一GOP的关键帧，再带上其后显示时间早于该关键帧的前导帧（它们属于本GOP的显示范围），
+ * 遇到第一个显示时间不早于终点的包为止
+ */
+static int reverse_step(VideoState *is, AVPacket *pkt)
+{
+    ReversePlay *rp = &is->rev;
+    AVStream *vst = is->video.video_st;
+    double tb = av_q2d(vst->time_base);
+    int64_t lo, hi = rp->gop_end, ts;
+    int passed = 0, n;
+
+    if (is->paused || rp->sent - rp->emitted > av_clip(reverse_depth, 1, REVERSE_DEPTH_MAX)) {
+        SDL_LockMutex(is->continue_read_mutex);
+        SDL_CondWaitTimeout(is->continue_read_thread, is->continue_read_mutex, 10);
+        SDL_UnlockMutex(is->continue_read_mutex);
+        return 0;
+    }
+
+    if ((lo = reverse_seek_keyframe(is, pkt)) == AV_NOPTS_VALUE) {
+        av_log(NULL, AV_LOG_INFO, "Reverse playback reached the start\n");
+        rp->requested = 0;
+        return 0;
+    }
+    rp->bounds[rp->sent % REVERSE_GOP_RING][0] = lo * tb;
+    rp->bounds[rp->sent % REVERSE_GOP_RING][1] = hi * tb;
+    packet_queue_put(&is->video.videoq, pkt);
+
+    for (n = 0; n < REVERSE_MAX_PACKETS; n++) {
+        if (av_read_frame(is->ic, pkt) < 0)
+            break;
+        if (pkt->stream_index != is->video_stream) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        if (ts != AV_NOPTS_VALUE && ts >= hi) {
+            if (passed) {
+                av_packet_unref(pkt);
+                break;
+            }
+            if (pkt->flags & AV_PKT_FLAG_KEY)
+                passed = 1;
+        }
+        packet_queue_put(&is->video.videoq, pkt);
     }
+    packet_queue_put_nullpacket(&is->video.videoq, pkt, is->video_stream);  // 让解码器排空本GOP
+
+    rp->sent++;
+    rp->gop_end = lo;
+    rp->pos = av_rescale_q(lo, vst->time_base, AV_TIME_BASE_Q);
+    return 0;
 }
 
 static int stream_has_enough_packets(AVStream *st, int stream_id, PacketQueue *queue) {
     return stream_id < 0 ||
            queue->abort_request ||
            (st->disposition & AV_DISPOSITION_ATTACHED_PIC) ||
-           queue->nb_packets > MIN_FRAMES && (!queue->duration || av_q2d(st->time_base) * queue->duration > 1.0);
+           st->codecpar->codec_type == AVMEDIA_TYPE_SUBTITLE ||   // 稀疏流不参与时长判断
+           queue->nb_packets > MIN_FRAMES && (!queue->duration || packet_queue_seconds(queue) >= queue->high_sec);
+}
+
+/*
+* 尝试在已缓冲的数据包内完成前向seek（不调用avformat_seek_file，不整体flush）
+* 视频按关键帧索引定位到目标之前最近的关键帧，音频/字幕丢弃早于该位置的数据包；
+* 没有视频时要求音频缓冲覆盖到目标时间
+* 返回1表示已完成（*pos为实际定位时间，AV_TIME_BASE），0表示需走常规seek
+*/
+static int stream_seek_in_buffer(VideoState *is, int64_t seek_min, int64_t seek_target, int64_t *pos)
+{
+    AVStream *vst = is->video.video_st, *ast = is->audio.audio_st, *sst = is->subtitle.subtitle_st;
+    int64_t ts;
+
+    if (!buffer_seek || spsc_queue || is->seek_rel <= 0 || (is->seek_flags & AVSEEK_FLAG_BYTE))
+        return 0;
+    // 目标之后的数据在溢出文件中时无法对齐各路流，交给解复用器
+    if (packet_queue_spilling(&is->video.videoq) || packet_queue_spilling(&is->audio.audioq))
+        return 0;
+
+    if (vst && !(vst->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+        if (!packet_queue_seek_keyframe(&is->video.videoq,
+                                        av_rescale_q(seek_min, AV_TIME_BASE_Q, vst->time_base),
+                                        av_rescale_q(seek_target, AV_TIME_BASE_Q, vst->time_base), &ts))
+            return 0;
+        *pos = av_rescale_q(ts, vst->time_base, AV_TIME_BASE_Q);
+        if (ast)
+            packet_queue_seek_pts(&is->audio.audioq, av_rescale_q(*pos, AV_TIME_BASE_Q, ast->time_base), 0);
+    } else if (ast) {
+        if (!packet_queue_seek_pts(&is->audio.audioq, av_rescale_q(seek_target, AV_TIME_BASE_Q, ast->time_base), 1))
+            return 0;
+        *pos = seek_target;
+        if (vst)
+            packet_queue_flush(&is->video.videoq);  // 附件封面随后由queue_attachments_req重新送入
+    } else {
+        return 0;
+    }
+    if (sst)
+        packet_queue_seek_pts(&is->subtitle.subtitleq, av_rescale_q(*pos, AV_TIME_BASE_Q, sst->time_base), 0);
+    av_log(NULL, AV_LOG_DEBUG, "in-buffer seek to %0.3f\n", *pos / (double)AV_TIME_BASE);
+    return 1;
+}
+
+/*
+* 尝试由回看缓冲完成向后seek：已播放的数据包放回队列头部重新解码，不调用avformat_seek_file
+* 视频回到目标之前最近的关键帧，并要求音频回看缓冲覆盖到该位置，否则计为未命中
+*/
+static int stream_rewind_in_buffer(VideoState *is, int64_t seek_target, int64_t *pos)
+{
+    AVStream *vst = is->video.video_st, *ast = is->audio.audio_st, *sst = is->subtitle.subtitle_st;
+    int64_t ts;
+
+    if ((rewind_max_sec <= 0 && rewind_max_bytes <= 0) || spsc_queue ||
+        is->seek_rel >= 0 || (is->seek_flags & AVSEEK_FLAG_BYTE))
+        return 0;
+
+    if (vst && !(vst->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+        /* 两路在同一次持锁内探测并提交，避免只回退了其中一路 */
+        if (!packet_queue_rewind_keyframe(&is->video.videoq, av_rescale_q(seek_target, AV_TIME_BASE_Q, vst->time_base), &ts,
+                                          ast ? &is->audio.audioq : NULL, vst->time_base,
+                                          ast ? ast->time_base : vst->time_base))
+            goto miss;
+        *pos = av_rescale_q(ts, vst->time_base, AV_TIME_BASE_Q);
+    } else if (ast) {
+        if (!packet_queue_rewind_pts(&is->audio.audioq, av_rescale_q(seek_target, AV_TIME_BASE_Q, ast->time_base), 1))
+            goto miss;
+        *pos = seek_target;
+        if (vst)
+            packet_queue_flush(&is->video.videoq);  // 附件封面随后由queue_attachments_req重新送入
+    } else {
+        return 0;
+    }
+    if (sst)
+        packet_queue_rewind_pts(&is->subtitle.subtitleq, av_rescale_q(*pos, AV_TIME_BASE_Q, sst->time_base), 0);
+    is->rewind_hits++;
+    av_log(NULL, AV_LOG_DEBUG, "rewind from memory to %0.3f\n", *pos / (double)AV_TIME_BASE);
+    return 1;
+miss:
+    is->rewind_misses++;
+    return 0;
+}
+
+static void update_buffer_watermarks(VideoState *is)
+{
+    if (is->audio.audio_st)
+        update_stream_watermarks(is, is->audio.audio_st, &is->audio.audioq);
+    if (is->video.video_st)
+        update_stream_watermarks(is, is->video.video_st, &is->video.videoq);
+    if (is->subtitle.subtitle_st)
+        update_stream_watermarks(is, is->subtitle.subtitle_st, &is->subtitle.subtitleq);
+}
+
+/*
+* 读线程是否应停读（滞回）：
+* - 全部队列合计超过BUFFER_TOTAL_MAX_BYTES或任一流超过字节高水位时停读，内存上限优先于低水位
+* - 未停读时，全部流都达到时长高水位才停读
+* - 已停读（stalled）时保持停读，直到某路音视频流降到低水位
+*/
+static int stream_buffers_full(VideoState *is, int stalled)
+{
+    const struct {
+        AVStream *st;
+        int stream_id;
+        PacketQueue *q;
+    } streams[] = {
+        { is->audio.audio_st,       is->audio_stream,    &is->audio.audioq },
+        { is->video.video_st,       is->video_stream,    &is->video.videoq },
+        { is->subtitle.subtitle_st, is->subtitle_stream, &is->subtitle.subtitleq },
+    };
+    int64_t total = 0;
+    int below_low = 0;
+
+    for (const auto &s : streams) {
+        if (s.stream_id < 0 || !s.st || (s.st->disposition & AV_DISPOSITION_ATTACHED_PIC))
+            continue;
+        if (s.q->size >= s.q->high_bytes)
+            return 1;
+        total += s.q->size;
+        if (s.st->codecpar->codec_type != AVMEDIA_TYPE_SUBTITLE && packet_queue_below_low(s.q))
+            below_low = 1;
+    }
+    if (total >= BUFFER_TOTAL_MAX_BYTES)
+        return 1;
+    if (below_low)
+        return 0;
+    return stalled ||
+           (stream_has_enough_packets(is->audio.audio_st, is->audio_stream, &is->audio.audioq) &&
+            stream_has_enough_packets(is->video.video_st, is->video_stream, &is->video.videoq) &&
+            stream_has_enough_packets(is->subtitle.subtitle_st, is->subtitle_stream, &is->subtitle.subtitleq));
 }
 
 static void stream_toggle_pause(VideoState *is)
@@ -1798,6 +3091,15 @@ static void step_to_next_frame(VideoState *is)
 }
 
 //读取数据线程
+/* 把read_thread攒下的连续音频包一次性送入音频队列（一次加锁、一次唤醒） */
+static void flush_audio_burst(VideoState *is, AVPacket **burst, int *nb)
+{
+    if (*nb > 0) {
+        packet_queue_put_batch(&is->audio.audioq, burst, *nb);
+        *nb = 0;
+    }
+}
+
 int read_thread(void *arg)
 {
     VideoState *is = reinterpret_cast<VideoState*>(arg);
@@ -1809,16 +3111,14 @@ int read_thread(void *arg)
     AVPacket* pkt = NULL;                   // 存储从流中读取的原始数据包
     int64_t stream_start_time;              // 流的起始时间
     int pkt_in_play_range = 0;              // 标识数据包是否在播放时间范围内
-    SDL_mutex* wait_mutex = SDL_CreateMutex(); // 同步互斥锁
+    SDL_mutex* wait_mutex = is->continue_read_mutex; // 同步互斥锁（与解码线程的低水位唤醒共用）
     int scan_all_pmts_set = 0;
     int64_t pkt_ts;
-
-    if (!wait_mutex)
-    {
-        av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex(): %s\n", SDL_GetError());
-        ret = AVERROR(ENOMEM);
-        goto fail;
-    }
+    AVPacket* audio_burst[PACKET_BATCH_MAX] = { NULL }; // 连续到达的音频包，攒批入队
+    int nb_audio_burst = 0;
+    int audio_burst_size = av_clip(packet_batch_size, 1, PACKET_BATCH_MAX);
+    int stalled = 0;                        // 当前是否处于水位停读状态
+    int64_t watermark_time = 0;             // 上次刷新字节水位的时间
 
     /* 初始化关键数据结构 */
     memset(st_index, -1, sizeof(st_index)); // 流索引初始化为-1
@@ -1830,6 +3130,13 @@ int read_thread(void *arg)
         ret = AVERROR(ENOMEM);
         goto fail;
     }
+    for (i = 0; audio_burst_size > 1 && i < audio_burst_size; i++) {
+        if (!(audio_burst[i] = av_packet_alloc())) {
+            av_log(NULL, AV_LOG_FATAL, "Could not allocate packet.\n");
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    }
 
     /* 初始化格式上下文 */
     if (!(ic = avformat_alloc_context())) {
@@ -1895,6 +3202,10 @@ int read_thread(void *arg)
     }
 
     is->realtime = is_realtime(ic); //判断输入媒体源是否为实时流媒体
+    if (is->realtime && is->rate != 1.0) {
+        av_log(NULL, AV_LOG_WARNING, "%s: -rate is ignored for realtime streams\n", is->filename);
+        is->rate = is->vidclk.speed = is->extclk.speed = 1.0;
+    }
 
     if (show_status)
         av_dump_format(ic, 0, is->filename, 0);
@@ -1992,19 +3303,41 @@ int read_thread(void *arg)
             continue;
         }
 #endif
+        /* 进入/退出关键帧快进快退（期间的seek请求会结束快进快退） */
+        if (is->trick.active && (!is->trick.speed || is->seek_req)) {
+            trick_play_stop(is);
+        } else if (is->rev.active && (!is->rev.requested || is->seek_req || is->trick.speed)) {
+            reverse_stop(is);
+        } else if (!is->trick.active && !is->rev.active && !is->seek_req && (is->trick.speed || is->rev.requested)) {
+            flush_audio_burst(is, audio_burst, &nb_audio_burst);
+            if (is->trick.speed)
+                trick_play_start(is);
+            else
+                reverse_start(is);
+        }
+
         /* 处理SEEK请求 */
         if (is->seek_req) {
+            flush_audio_burst(is, audio_burst, &nb_audio_burst);
             int64_t seek_target = is->seek_pos;
             int64_t seek_min    = is->seek_rel > 0 ? seek_target - is->seek_rel + 2: INT64_MIN;
             int64_t seek_max    = is->seek_rel < 0 ? seek_target - is->seek_rel - 2: INT64_MAX;
             // FIXME the +-2 is due to rounding being not done in the correct direction in generation
             //      of the seek_pos/seek_rel variables
-
-            ret = avformat_seek_file(is->ic, -1, seek_min, seek_target, seek_max, is->seek_flags);
-            if (ret < 0) {
+            int old_video_serial = is->video.videoq.serial;
+            int old_audio_serial = is->audio.audioq.serial;
+
+            accurate_seek_arm(is, seek_target);
+            if (stream_seek_in_buffer(is, seek_min, seek_target, &seek_target) ||
+                stream_rewind_in_buffer(is, seek_target, &seek_target)) {
+                is->buffer_seeks++;
+                set_clock(&is->extclk, seek_target / (double)AV_TIME_BASE, 0);
+                ret = 0;
+            } else if ((ret = avformat_seek_file(is->ic, -1, seek_min, seek_target, seek_max, is->seek_flags)) < 0) {
                 av_log(NULL, AV_LOG_ERROR,
                        "%s: error while seeking\n", is->ic->url);
             } else {
+                is->demux_seeks++;
                 if (is->audio_stream >= 0)
                     packet_queue_flush(&is->audio.audioq);
                 if (is->subtitle_stream >= 0)
@@ -2017,6 +3350,7 @@ int read_thread(void *arg)
                     set_clock(&is->extclk, seek_target / (double)AV_TIME_BASE, 0);
                 }
             }
+            accurate_seek_commit(is, ret >= 0, old_video_serial, old_audio_serial);
             is->seek_req = 0;
             is->queue_attachments_req = 1;
             is->eof = 0;
@@ -2035,20 +3369,53 @@ int read_thread(void *arg)
             is->queue_attachments_req = 0;
         }
 
-        /* if the queue are full, no need to read more */
-        if (infinite_buffer<1 &&
-                (is->audio.audioq.size + is->video.videoq.size + is->subtitle.subtitleq.size > MAX_QUEUE_SIZE
-            || (stream_has_enough_packets(is->audio.audio_st, is->audio_stream, &is->audio.audioq) &&
-                stream_has_enough_packets(is->video.video_st, is->video_stream, &is->video.videoq) &&
-                stream_has_enough_packets(is->subtitle.subtitle_st, is->subtitle_stream, &is->subtitle.subtitleq)))) {
-            /* wait 10 ms */
+        if (is->trick.active) {
+            if ((ret = trick_play_step(is, pkt)) < 0 && ic->pb && ic->pb->error)
+                goto fail;
+            continue;
+        }
+        if (is->rev.active) {
+            reverse_step(is, pkt);
+            continue;
+        }
+
+        /* 缓冲达到高水位时停读，直到某路音视频流降到低水位被解码线程唤醒；字节水位每秒按码率刷新一次 */
+        if (av_gettime_relative() - watermark_time >= WATERMARK_UPDATE_INTERVAL) {
+            update_buffer_watermarks(is);
+            watermark_time = av_gettime_relative();
+        }
+        if (infinite_buffer<1 && stream_buffers_full(is, stalled)) {
+            flush_audio_burst(is, audio_burst, &nb_audio_burst);
             SDL_LockMutex(wait_mutex);
-            SDL_CondWaitTimeout(is->continue_read_thread, wait_mutex, 10);
+            is->audio.audioq.reader_waiting = 1;
+            is->video.videoq.reader_waiting = 1;
+            // 登记等待后复查，避免与解码线程的唤醒错过
+            if (!is->abort_request && !is->seek_req && stream_buffers_full(is, stalled)) {
+                int64_t wait = packet_queue_clock(&is->video.videoq);
+                if (!stalled) {
+                    is->read_stalls++;
+                    /* 互斥模式没有容量上限，按水位停读即为队列满，与SPSC环满同口径计数 */
+                    if (!spsc_queue) {
+                        is->audio.audioq.full_events.fetch_add(1, std::memory_order_relaxed);
+                        is->video.videoq.full_events.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+                stalled = 1;
+                SDL_CondWaitTimeout(is->continue_read_thread, wait_mutex, READ_THREAD_IDLE_TIMEOUT);
+                if (!spsc_queue) {
+                    packet_queue_record(&is->audio.audioq, &is->audio.audioq.producer_wait, wait);
+                    packet_queue_record(&is->video.videoq, &is->video.videoq.producer_wait, wait);
+                }
+            }
+            is->audio.audioq.reader_waiting = 0;
+            is->video.videoq.reader_waiting = 0;
             SDL_UnlockMutex(wait_mutex);
             continue;
         }
+        stalled = 0;
         if (!is->paused &&
-            (!is->audio.audio_st || (is->audio.auddec.finished == is->audio.audioq.serial && frame_queue_nb_remaining(&is->audio.sampq) == 0)) &&
+            (!is->audio.audio_st || (is->audio.auddec.finished == is->audio.audioq.serial && frame_queue_nb_remaining(&is->audio.sampq) == 0 &&
+                                     !pcm_ring_fill(&is->audio.pcm))) &&
             (!is->video.video_st || (is->video.viddec.finished == is->video.videoq.serial && frame_queue_nb_remaining(&is->video.pictq) == 0))) {
             if (loop != 1 && (!loop || --loop)) {
                 stream_seek(is, start_time != AV_NOPTS_VALUE ? start_time : 0, 0, 0);
@@ -2059,6 +3426,7 @@ int read_thread(void *arg)
         }
         /* 读取媒体帧 */
         if ((ret = av_read_frame(ic, pkt)) < 0) {
+            flush_audio_burst(is, audio_burst, &nb_audio_burst);
             // 处理流结束情况
             if ((ret == AVERROR_EOF || avio_feof(ic->pb)) && !is->eof) {
                 if (is->video_stream >= 0)
@@ -2092,9 +3460,21 @@ int read_thread(void *arg)
                                     (double)(start_time != AV_NOPTS_VALUE ? start_time : 0) / 1000000
                                 <= ((double)duration / 1000000);
         if (pkt->stream_index == is->audio_stream && pkt_in_play_range) {
-            packet_queue_put(&is->audio.audioq, pkt);
-        } else if (pkt->stream_index == is->video_stream && pkt_in_play_range
-                   && !(is->video.video_st->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+            if (audio_burst_size > 1) {
+                /* 连续的小音频包先攒起来，遇到其他流的包或攒满时一次入队 */
+                av_packet_move_ref(audio_burst[nb_audio_burst++], pkt);
+                if (nb_audio_burst == audio_burst_size || is->audio.audioq.nb_packets == 0)
+                    flush_audio_burst(is, audio_burst, &nb_audio_burst);
+            } else {
+                packet_queue_put(&is->audio.audioq, pkt);
+            }
+            continue;
+        }
+        flush_audio_burst(is, audio_burst, &nb_audio_burst);
+        if (pkt->stream_index == is->video_stream && pkt_in_play_range
+            && !(is->video.video_st->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+            if (latency_trace)
+                packet_trace_demux(pkt);
             packet_queue_put(&is->video.videoq, pkt);
         } else if (pkt->stream_index == is->subtitle_stream && pkt_in_play_range) {
             packet_queue_put(&is->subtitle.subtitleq, pkt);
@@ -2109,6 +3489,8 @@ fail: /* 错误处理段 */
         avformat_close_input(&ic);
 
     av_packet_free(&pkt);
+    for (i = 0; i < PACKET_BATCH_MAX; i++)
+        av_packet_free(&audio_burst[i]);
     if (ret != 0) {
         SDL_Event event;
 
@@ -2116,7 +3498,6 @@ fail: /* 错误处理段 */
         event.user.data1 = is;
         SDL_PushEvent(&event);
     }
-    SDL_DestroyMutex(wait_mutex);
     return 0;
 }
 
@@ -2138,28 +3519,58 @@ static VideoState *stream_open(const char *filename,
     is->iformat = iformat;
     is->ytop    = 0;
     is->xleft   = 0;
+    is->aseek.video_serial = is->aseek.audio_serial = INT_MAX;
+    is->rev.serial = is->rev.cache_serial = -1;
+    is->aseek.video_done = is->aseek.audio_done = -1;
 
     /* start video display */
-    if (frame_queue_init(&is->video.pictq, &is->video.videoq, VIDEO_PICTURE_QUEUE_SIZE, 1) < 0)
+    if (frame_queue_init(&is->video.pictq, &is->video.videoq, video_frame_queue, video_frame_queue_max, 1) < 0)
         goto fail;
-    if (frame_queue_init(&is->subtitle.subpq, &is->subtitle.subtitleq, SUBPICTURE_QUEUE_SIZE, 0) < 0)
+    if (frame_queue_init(&is->subtitle.subpq, &is->subtitle.subtitleq, subtitle_frame_queue, subtitle_frame_queue, 0) < 0)
         goto fail;
-    if (frame_queue_init(&is->audio.sampq, &is->audio.audioq, SAMPLE_QUEUE_SIZE, 1) < 0)
+    if (frame_queue_init(&is->audio.sampq, &is->audio.audioq, sample_frame_queue, sample_frame_queue, 1) < 0)
         goto fail;
 
-    if (packet_queue_init(&is->video.videoq) < 0 ||
-        packet_queue_init(&is->audio.audioq) < 0 ||
-        packet_queue_init(&is->subtitle.subtitleq) < 0)
+    if (spsc_queue) {
+        /* read_thread是唯一生产者，各解码线程是唯一消费者，满足SPSC前提 */
+        if (packet_queue_init_spsc(&is->video.videoq, spsc_queue_size) < 0 ||
+            packet_queue_init_spsc(&is->audio.audioq, spsc_queue_size) < 0 ||
+            packet_queue_init_spsc(&is->subtitle.subtitleq, spsc_queue_size) < 0)
+            goto fail;
+    } else if (packet_queue_init(&is->video.videoq) < 0 ||
+               packet_queue_init(&is->audio.audioq) < 0 ||
+               packet_queue_init(&is->subtitle.subtitleq) < 0 ||
+               (buffer_seek && packet_queue_init_index(&is->video.videoq) < 0))
+        goto fail;
+    if (!spsc_queue && (rewind_max_sec > 0 || rewind_max_bytes > 0)) {
+        int64_t max_bytes = rewind_max_bytes > 0 ? rewind_max_bytes : REWIND_DEFAULT_MAX_BYTES;
+        if (packet_queue_init_rewind(&is->video.videoq, rewind_max_sec, max_bytes) < 0 ||
+            packet_queue_init_rewind(&is->audio.audioq, rewind_max_sec, max_bytes) < 0 ||
+            packet_queue_init_rewind(&is->subtitle.subtitleq, rewind_max_sec, max_bytes) < 0)
+            goto fail;
+    }
+    if (audio_slab && packet_queue_init_slab(&is->audio.audioq) < 0)
+        goto fail;
+    if (!spsc_queue && spill_budget > 0 &&
+        (packet_queue_init_spill(&is->video.videoq, spill_budget, spill_dir) < 0 ||
+         packet_queue_init_spill(&is->audio.audioq, spill_budget, spill_dir) < 0))
         goto fail;
 
     if (!(is->continue_read_thread = SDL_CreateCond())) {
         av_log(NULL, AV_LOG_FATAL, "SDL_CreateCond(): %s\n", SDL_GetError());
         goto fail;
     }
+    if (!(is->continue_read_mutex = SDL_CreateMutex())) {
+        av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex(): %s\n", SDL_GetError());
+        goto fail;
+    }
+    packet_queue_set_reader(&is->video.videoq, is->continue_read_mutex, is->continue_read_thread);
+    packet_queue_set_reader(&is->audio.audioq, is->continue_read_mutex, is->continue_read_thread);
 
     init_clock(&is->vidclk, &is->video.videoq.serial);
     init_clock(&is->audclk, &is->audio.audioq.serial);
     init_clock(&is->extclk, &is->extclk.serial);
+    is->rate = is->vidclk.speed = is->extclk.speed = playback_rate;
     is->audio_clock_serial = -1;
     if (startup_volume < 0)
         av_log(NULL, AV_LOG_WARNING, "-volume=%d < 0, setting to 0\n", startup_volume);
@@ -2186,6 +3597,34 @@ static void set_clock_speed(Clock *c, double speed)
     c->speed = speed;
 }
 
+/* 设置播放倍速：视频/外部时钟立即改速，音频经audio_thread重建滤镜图后按新倍速输出 */
+static void playback_rate_set(VideoState *is, double rate)
+{
+    rate = av_clipd(rate, PLAYBACK_RATE_MIN, PLAYBACK_RATE_MAX);
+    if (rate == is->rate)
+        return;
+    if (is->realtime) {
+        av_log(NULL, AV_LOG_WARNING, "Playback rate cannot be changed on realtime streams\n");
+        return;
+    }
+    set_clock_speed(&is->vidclk, rate);
+    set_clock_speed(&is->extclk, rate);
+    is->rate = rate;
+    av_log(NULL, AV_LOG_INFO, "Playback rate %.2fx\n", rate);
+}
+
+/* 按键 , . 在playback_rates中逐级切换 */
+static void playback_rate_change(VideoState *is, int dir)
+{
+    int i, n = FF_ARRAY_ELEMS(playback_rates);
+
+    for (i = 0; i < n - 1 && playback_rates[i] < is->rate; i++)
+        ;
+    if (dir < 0 || playback_rates[i] == is->rate)
+        i += dir;
+    playback_rate_set(is, playback_rates[av_clip(i, 0, n - 1)]);
+}
+
 static void check_external_clock_speed(VideoState *is) {
     if (is->video_stream >= 0 && is->video.videoq.nb_packets <= EXTERNAL_CLOCK_MIN_FRAMES ||
         is->audio_stream >= 0 && is->audio.audioq.nb_packets <= EXTERNAL_CLOCK_MIN_FRAMES) {
@@ -2265,7 +3704,7 @@ static inline int compute_mod(int a, int b)
 
 static void video_audio_display(VideoState *s)
 {
-    int i, i_start, x, y1, y, ys, delay, n, nb_display_channels;
+    int i, i_start, x, y1, y, ys, delay, nb_display_channels;
     int ch, channels, h, h2;
     int64_t time_diff;
     int rdft_bits, nb_freq;
@@ -2279,9 +3718,7 @@ static void video_audio_display(VideoState *s)
     nb_display_channels = channels;
     if (!s->paused) {
         int data_used= s->show_mode == VideoState::ShowMode::SHOW_MODE_WAVES ? s->width : (2*nb_freq);
-        n = 2 * channels;
-        delay = s->audio.audio_write_buf_size;
-        delay /= n;
+        delay = 0;   // 回调把送出的样本写入sample_array，没有回调内的残留缓冲
 
         /* to be more precise, we take into account the time spent since
            the last buffer computation */
@@ -2549,6 +3986,11 @@ static void video_image_display(VideoState *is)
         }
         vp->uploaded = 1;
         vp->flip_v = vp->frame->linesize[0] < 0;
+        if (latency_trace && vp->lat.ts[LAT_QUEUED]) {
+            vp->lat.ts[LAT_UPLOADED] = av_gettime_relative();
+            is->latency.pending = vp->lat;
+            is->latency.has_pending = 1;
+        }
     }
 
     SDL_RenderCopyEx(renderer, is->video.vid_texture, NULL, &rect, 0, NULL, vp->flip_v ? SDL_FLIP_VERTICAL : static_cast<SDL_RendererFlip>(0));
@@ -2584,6 +4026,12 @@ static void video_display(VideoState *is)
     else if (is->video.video_st)
         video_image_display(is);
     SDL_RenderPresent(renderer);
+    if (is->latency.has_pending) {
+        /* 新上传的帧第一次上屏 */
+        is->latency.pending.ts[LAT_PRESENTED] = av_gettime_relative();
+        latency_trace_add(&is->latency, &is->latency.pending);
+        is->latency.has_pending = 0;
+    }
 }
 
 static double vp_duration(VideoState *is, Frame *vp, Frame *nextvp) {
@@ -2606,7 +4054,7 @@ static double compute_target_delay(double delay, VideoState *is)
     if (get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER) {
         /* if video is slave, we try to correct big delays by
            duplicating or deleting a frame */
-        diff = get_clock(&is->vidclk) - get_master_clock(is);
+        diff = (get_clock(&is->vidclk) - get_master_clock(is)) / is->rate;   // 换算为墙钟时间
 
         /* skip or repeat frame. We take into account the
            delay to compute the threshold. I still don't know
@@ -2678,7 +4126,7 @@ retry:
                 goto display;
 
             /* compute nominal last_duration */
-            last_duration = vp_duration(is, lastvp, vp);
+            last_duration = vp_duration(is, lastvp, vp) / is->rate;
             delay = compute_target_delay(last_duration, is);
 
             time= av_gettime_relative()/1000000.0;
@@ -2698,9 +4146,9 @@ retry:
 
             if (frame_queue_nb_remaining(&is->video.pictq) > 1) {
                 Frame *nextvp = frame_queue_peek_next(&is->video.pictq);
-                duration = vp_duration(is, vp, nextvp);
+                duration = vp_duration(is, vp, nextvp) / is->rate;
                 if(!is->step && (framedrop>0 || (framedrop && get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER)) && time > is->video.frame_timer + duration){
-                    is->frame_drops_late++;
+                    is->video.frame_drops_late++;
                     frame_queue_next(&is->video.pictq);
                     goto retry;
                 }
@@ -2740,6 +4188,7 @@ retry:
                 }
             }
 
+            is->trick.shown_serial = vp->serial;   // 关键帧播放据此判断上一帧已显示
             frame_queue_next(&is->video.pictq);
             is->force_refresh = 1;
 
@@ -2757,7 +4206,10 @@ display:
         static int64_t last_time;
         int64_t cur_time;
         int aqsize, vqsize, sqsize;
-        double av_diff;
+        int afill, vfill;
+        static int64_t last_awaited, last_vwaited;
+        int64_t awaited, vwaited;
+        double av_diff, interval;
 
         cur_time = av_gettime_relative();
         if (!last_time || (cur_time - last_time) >= 30000) {
@@ -2770,6 +4222,12 @@ display:
                 vqsize = is->video.videoq.size;
             if (is->subtitle.subtitle_st)
                 sqsize = is->subtitle.subtitleq.size;
+            afill = is->audio.audio_st ? packet_queue_fill_percent(&is->audio.audioq) : 0;
+            vfill = is->video.video_st ? packet_queue_fill_percent(&is->video.videoq) : 0;
+            /* 解码线程在空队列上等待的时间占比：高说明读线程供给不足，低而队列满说明解码慢 */
+            awaited = is->audio.audioq.consumer_wait.total_us.load();
+            vwaited = is->video.videoq.consumer_wait.total_us.load();
+            interval = last_time ? (double)(cur_time - last_time) : 0;
             av_diff = 0;
             if (is->audio.audio_st && is->video.video_st)
                 av_diff = get_clock(&is->audclk) - get_clock(&is->vidclk);
@@ -2780,14 +4238,29 @@ display:
 
             av_bprint_init(&buf, 0, AV_BPRINT_SIZE_AUTOMATIC);
             av_bprintf(&buf,
-                      "%7.2f %s:%7.3f fd=%4d aq=%5dKB vq=%5dKB sq=%5dB \r",
+                      "%7.2f %s:%7.3f fd=%4d aq=%5dKB(%3d%%) vq=%5dKB(%3d%%) sq=%5dB st=%d as=%3d%% vs=%3d%% fq=%d ",
                       get_master_clock(is),
                       (is->audio.audio_st && is->video.video_st) ? "A-V" : (is->video.video_st ? "M-V" : (is->audio.audio_st ? "M-A" : "   ")),
                       av_diff,
-                      is->video.frame_drops_early + is->video.frame_drops_late,
-                      aqsize / 1024,
-                      vqsize / 1024,
-                      sqsize);
+                      is->video.frame_drops_early + is->video.frame_drops_late + is->video.frame_drops_pkt,
+                      aqsize / 1024, afill,
+                      vqsize / 1024, vfill,
+                      sqsize,
+                      is->read_stalls,
+                      interval > 0 ? (int)FFMIN(100, 100 * (awaited - last_awaited) / interval) : 0,
+                      interval > 0 ? (int)FFMIN(100, 100 * (vwaited - last_vwaited) / interval) : 0,
+                      is->video.pictq.max_size);
+            if (is->latency.nb[0])
+                av_bprintf(&buf, "lat=%3dms ", (int)(latency_trace_percentile(&is->latency, 0, 0.5) / 1000));
+            if (is->trick.active)
+                av_bprintf(&buf, "trick=%+dx@%0.1f ", is->trick.speed.load(), is->trick.pos / (double)AV_TIME_BASE);
+            if (is->rate != 1.0)
+                av_bprintf(&buf, "rate=%.2fx ", is->rate.load());
+            if (is->rev.active)
+                av_bprintf(&buf, "rev@%0.1f cache=%dMB ", is->rev.pos / (double)AV_TIME_BASE, (int)(is->rev.cache_bytes >> 20));
+            av_bprintf(&buf, "\r");
+            last_awaited = awaited;
+            last_vwaited = vwaited;
 
             if (show_status == 1 && AV_LOG_INFO > av_log_get_level())
                 fprintf(stderr, "%s", buf.str);
@@ -3000,6 +4473,21 @@ static void event_loop(VideoState *cur_stream)
             case SDLK_s: // S: Step to next frame
                 step_to_next_frame(cur_stream);
                 break;
+            case SDLK_LEFTBRACKET:
+                trick_play_change(cur_stream, -1);
+                break;
+            case SDLK_RIGHTBRACKET:
+                trick_play_change(cur_stream, 1);
+                break;
+            case SDLK_COMMA:
+                playback_rate_change(cur_stream, -1);
+                break;
+            case SDLK_PERIOD:
+                playback_rate_change(cur_stream, 1);
+                break;
+            case SDLK_r:
+                reverse_toggle(cur_stream);
+                break;
             case SDLK_a:
                 stream_cycle_channel(cur_stream, AVMEDIA_TYPE_AUDIO);
                 break;
@@ -3064,7 +4552,12 @@ static void event_loop(VideoState *cur_stream)
                         pos += incr;
                         stream_seek(cur_stream, pos, incr, 1);
                     } else {
-                        pos = get_master_clock(cur_stream);
+                        if (cur_stream->trick.active)
+                            pos = cur_stream->trick.pos / (double)AV_TIME_BASE;
+                        else if (cur_stream->rev.active)
+                            pos = cur_stream->rev.pos / (double)AV_TIME_BASE;
+                        else
+                            pos = get_master_clock(cur_stream);
                         if (isnan(pos))
                             pos = (double)cur_stream->seek_pos / AV_TIME_BASE;
                         pos += incr;
@@ -3175,6 +4668,31 @@ static void show_usage(void)
     av_log(NULL, AV_LOG_INFO, "  -showmode <mode>        video | waves | rdft\n");
     av_log(NULL, AV_LOG_INFO, "  -sync <type>            audio | video | ext\n");
     av_log(NULL, AV_LOG_INFO, "  -hwaccel <name>         Enable the given hardware accel\n");
+    av_log(NULL, AV_LOG_INFO, "  -spsc_queue             Use lock-free SPSC packet queues\n");
+    av_log(NULL, AV_LOG_INFO, "  -spsc_queue_size <n>    SPSC queue capacity in packets (implies -spsc_queue)\n");
+    av_log(NULL, AV_LOG_INFO, "  -pkt_batch <n>          Move up to n packets per queue lock (1 disables, max 32)\n");
+    av_log(NULL, AV_LOG_INFO, "  -abuf/-vbuf/-sbuf <l:h> Per-stream buffer watermarks, e.g. 1s:3s or 512K:8M\n");
+    av_log(NULL, AV_LOG_INFO, "  -nobufseek              Always seek through the demuxer, even if the target is buffered\n");
+    av_log(NULL, AV_LOG_INFO, "  -rewind <30s|64M>       Keep played packets for instant backward seeks (repeatable)\n");
+    av_log(NULL, AV_LOG_INFO, "  -spill <size>           Per-queue RAM budget; excess packets go to a temp file (use with -infbuf)\n");
+    av_log(NULL, AV_LOG_INFO, "  -spill_dir <dir>        Directory for spill files (default TMPDIR/TEMP)\n");
+    av_log(NULL, AV_LOG_INFO, "  -qstats/-noqstats       Time packet queue waits and lock holds (default: on with -stats)\n");
+    av_log(NULL, AV_LOG_INFO, "  -aslab                  Pack small audio packets into a slab arena\n");
+    av_log(NULL, AV_LOG_INFO, "  -noafloat               Always open the audio device as S16 instead of preferring F32\n");
+    av_log(NULL, AV_LOG_INFO, "  -novpool                Use FFmpeg's default video frame allocator\n");
+    av_log(NULL, AV_LOG_INFO, "  -nopktdrop              Don't drop non-reference video packets before decoding when late\n");
+    av_log(NULL, AV_LOG_INFO, "  -accurate_seek          Decode up to the exact seek target instead of the previous keyframe\n");
+    av_log(NULL, AV_LOG_INFO, "  -reverse_depth <n>      GOPs decoded ahead during reverse playback (1-8, default 2)\n");
+    av_log(NULL, AV_LOG_INFO, "  -reverse_mem <MB>       Frame cache limit for reverse playback (default 512)\n");
+    av_log(NULL, AV_LOG_INFO, "  -rate <x>               Playback rate with pitch kept (0.25-4, keys , and .)\n");
+    av_log(NULL, AV_LOG_INFO, "  -trace_latency          Trace per-stage video frame latency (demux to present)\n");
+    av_log(NULL, AV_LOG_INFO, "  -shared_pool            Run codec/filter slice jobs on one process-wide worker pool\n");
+    av_log(NULL, AV_LOG_INFO, "  -pool_threads <n>       Shared pool worker threads (default cores-1, implies -shared_pool)\n");
+    av_log(NULL, AV_LOG_INFO, "  -gop_parallel <n>       Decode intra-only video with n decoders in parallel\n");
+    av_log(NULL, AV_LOG_INFO, "  -gop_closed             Treat every video keyframe as a closed GOP for -gop_parallel\n");
+    av_log(NULL, AV_LOG_INFO, "  -autodegrade            Skip loop filter/IDCT/non-ref frames while decoding can't keep up\n");
+    av_log(NULL, AV_LOG_INFO, "  -vfq/-afq/-sfq <n>      Video/audio/subtitle frame queue depth (default 3/9/16)\n");
+    av_log(NULL, AV_LOG_INFO, "  -vfq_max <n>            Let the video frame queue grow to n on decode jitter (default 8)\n");
     av_log(NULL, AV_LOG_INFO, "  -format <name>          Force input format (alias: -f)\n");
     av_log(NULL, AV_LOG_INFO, "  -loglevel <level>       Set FFmpeg logging verbosity\n");
     av_log(NULL, AV_LOG_INFO, "  --dump-metadata         Print an input metadata summary\n");
@@ -3262,6 +4780,101 @@ static void parse_command_line(int argc, char **argv)
                 genpts = 1;
             } else if (option_name == "-infbuf") {
                 infinite_buffer = 1;
+            } else if (option_name == "-bufseek") {
+                buffer_seek = 1;
+            } else if (option_name == "-nobufseek") {
+                buffer_seek = 0;
+            } else if (option_name == "-rewind") {
+                const char *value = require_value(option_name);
+                double sec = 0;
+                int64_t bytes = 0;
+                if (parse_watermark_value(option_name.c_str(), value, &sec, &bytes))
+                    rewind_max_sec = sec;
+                else
+                    rewind_max_bytes = bytes;
+            } else if (option_name == "-spill") {
+                const char *value = require_value(option_name);
+                double sec = 0;
+                if (parse_watermark_value(option_name.c_str(), value, &sec, &spill_budget) || spill_budget <= 0)
+                    option_fail(option_name.c_str(), "Expected a byte size", value);
+            } else if (option_name == "-vfq" || option_name == "-vfq_max" ||
+                       option_name == "-afq" || option_name == "-sfq") {
+                int depth = parse_int_option(option_name.c_str(), require_value(option_name));
+                /* pictq/sampq保留最后显示的一帧，深度1时生产者永远等不到空位 */
+                int min_depth = option_name == "-sfq" ? 1 : 2;
+                if (depth < min_depth || depth > FRAME_QUEUE_MAX_SIZE)
+                    option_fail(option_name.c_str(), min_depth == 2 ? "Frame queue depth must be between 2 and 64"
+                                                                    : "Frame queue depth must be between 1 and 64");
+                if (option_name == "-vfq")
+                    video_frame_queue = depth;
+                else if (option_name == "-vfq_max")
+                    video_frame_queue_max = depth;
+                else if (option_name == "-afq")
+                    sample_frame_queue = depth;
+                else
+                    subtitle_frame_queue = depth;
+            } else if (option_name == "-gop_parallel") {
+                gop_parallel = parse_int_option(option_name.c_str(), require_value(option_name));
+                if (gop_parallel < 0 || gop_parallel > GOP_PARALLEL_MAX)
+                    option_fail(option_name.c_str(), "Parallel decoder count must be between 0 and 32");
+            } else if (option_name == "-autodegrade") {
+                auto_degrade = 1;
+            } else if (option_name == "-gop_closed") {
+                gop_closed = 1;
+            } else if (option_name == "-shared_pool") {
+                shared_pool = 1;
+            } else if (option_name == "-pool_threads") {
+                shared_pool_threads = parse_int_option(option_name.c_str(), require_value(option_name));
+                if (shared_pool_threads < 1 || shared_pool_threads > WORKER_POOL_MAX)
+                    option_fail(option_name.c_str(), "Worker pool size must be between 1 and 64");
+                shared_pool = 1;
+            } else if (option_name == "-trace_latency") {
+                latency_trace = 1;
+            } else if (option_name == "-reverse_depth") {
+                reverse_depth = parse_int_option(option_name.c_str(), require_value(option_name));
+                if (reverse_depth < 1 || reverse_depth > REVERSE_DEPTH_MAX)
+                    option_fail(option_name.c_str(), "GOP depth must be between 1 and 8");
+            } else if (option_name == "-reverse_mem") {
+                reverse_mem = parse_int_option(option_name.c_str(), require_value(option_name));
+                if (reverse_mem < 16)
+                    option_fail(option_name.c_str(), "Cache limit must be at least 16 (MB)");
+            } else if (option_name == "-rate") {
+                playback_rate = parse_double_option(option_name.c_str(), require_value(option_name));
+                if (playback_rate < PLAYBACK_RATE_MIN || playback_rate > PLAYBACK_RATE_MAX)
+                    option_fail(option_name.c_str(), "Rate must be between 0.25 and 4");
+            } else if (option_name == "-accurate_seek") {
+                accurate_seek = 1;
+            } else if (option_name == "-pktdrop" || option_name == "-nopktdrop") {
+                packet_drop = option_name == "-pktdrop";
+            } else if (option_name == "-vpool" || option_name == "-novpool") {
+                video_frame_pool = option_name == "-vpool";
+            } else if (option_name == "-aslab") {
+                audio_slab = 1;
+            } else if (option_name == "-afloat" || option_name == "-noafloat") {
+                audio_float = option_name == "-afloat";
+            } else if (option_name == "-qstats") {
+                queue_stats = 1;
+            } else if (option_name == "-noqstats") {
+                queue_stats = 0;
+            } else if (option_name == "-spill_dir") {
+                assign_string_option(&spill_dir, require_value(option_name), option_name.c_str());
+            } else if (option_name == "-spsc_queue") {
+                spsc_queue = 1;
+            } else if (option_name == "-spsc_queue_size") {
+                spsc_queue_size = parse_int_option(option_name.c_str(), require_value(option_name));
+                if (spsc_queue_size <= 0)
+                    option_fail(option_name.c_str(), "Capacity must be positive");
+                spsc_queue = 1;
+            } else if (option_name == "-pkt_batch") {
+                packet_batch_size = parse_int_option(option_name.c_str(), require_value(option_name));
+                if (packet_batch_size < 1 || packet_batch_size > PACKET_BATCH_MAX)
+                    option_fail(option_name.c_str(), "Batch size must be between 1 and 32");
+            } else if (option_name == "-abuf") {
+                parse_buffer_watermarks(AVMEDIA_TYPE_AUDIO, option_name.c_str(), require_value(option_name));
+            } else if (option_name == "-vbuf") {
+                parse_buffer_watermarks(AVMEDIA_TYPE_VIDEO, option_name.c_str(), require_value(option_name));
+            } else if (option_name == "-sbuf") {
+                parse_buffer_watermarks(AVMEDIA_TYPE_SUBTITLE, option_name.c_str(), require_value(option_name));
             } else if (option_name == "-find_stream_info") {
                 find_stream_info = parse_int_option(option_name.c_str(), require_value(option_name));
             } else if (option_name == "-x") {
@@ -3472,6 +5085,11 @@ int ffplay_main(int argc, char **argv)
         }
     }
 
+    if (shared_pool && worker_pool_create(&worker_pool, shared_pool_threads) < 0) {
+        av_log(NULL, AV_LOG_FATAL, "Failed to create the shared worker pool\n");
+        do_exit(NULL);
+    }
+
     is = stream_open(input_filename, file_iformat);
     if(!is)
     {
@@ -3483,3 +5101,6 @@ int ffplay_main(int argc, char **argv)
 
     return 0;
 }
+
+/* 内部基准测试（--bench）与播放器同属一个翻译单元 */
+#include "bench.inc"
@@ -11,6 +11,8 @@
 #undef main
 
 extern int ffplay_main(int argc, char **argv);
+extern bool run_benchmark(const std::string &name);
+extern void list_benchmarks();
 
 namespace {
 
@@ -61,14 +63,18 @@ std::string format_duration(int64_t duration) {
 }
 
 void print_usage(const char *program_name) {
-    std::cout << "Usage: " << program_name << " [--check-deps] [--probe <media>] <ffplay options>\n"
+    std::cout << "Usage: " << program_name << " [--check-deps] [--probe <media>] [--bench <suite>] <ffplay options>\n"
               << "\n"
               << "Additional helper options:\n"
               << "  --check-deps        Verify FFmpeg/SDL versions and initialization\n"
               << "  --probe <media>     Print container/stream metadata without starting playback\n"
+              << "  --bench <suite>     Run an internal micro-benchmark (\"all\" runs every suite)\n"
               << "  -h, --help          Show this help message\n"
               << "\n"
-              << "All unrecognized arguments are forwarded to the original ffplay entry point.\n";
+              << "All unrecognized arguments are forwarded to the original ffplay entry point.\n"
+              << "\n"
+              << "Benchmark suites:\n";
+    list_benchmarks();
 }
 
 bool run_dependency_check() {
@@ -218,6 +224,7 @@ int main(int argc, char **argv) {
     bool performed_action = false;
     bool dependency_check = false;
     std::vector<std::string> probe_paths;
+    std::vector<std::string> bench_names;
 
     for (int i = 1; i < argc; ++i) {
         const char *arg = argv[i];
@@ -243,6 +250,15 @@ int main(int argc, char **argv) {
             performed_action = true;
             continue;
         }
+        if (!std::strcmp(arg, "--bench")) {
+            if (i + 1 >= argc) {
+                std::cerr << "--bench requires a suite name" << std::endl;
+                return 1;
+            }
+            bench_names.emplace_back(argv[++i]);
+            performed_action = true;
+            continue;
+        }
         forwarded_args.push_back(argv[i]);
     }
 
@@ -262,6 +278,11 @@ int main(int argc, char **argv) {
             return 1;
     }
 
+    for (const auto &name : bench_names) {
+        if (!run_benchmark(name))
+            return 1;
+    }
+
     if (forwarded_args.size() > 1) {
         forwarded_args.push_back(nullptr);
         return ffplay_main(static_cast<int>(forwarded_args.size()) - 1, forwarded_args.data());